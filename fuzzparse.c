@@ -0,0 +1,165 @@
+/*
+ * fuzzparse.c - Fuzz harness for the command line tokenizer
+ *
+ * usage: fuzzparse <file or directory>...
+ *
+ * Each input is one command line. It is tokenized with parseline and
+ * splitpipeline, then every word is quoted again with single quotes
+ * (the | and redirection operators are written back bare) and the
+ * result is tokenized a second time, which must give back the same
+ * words, the same operators, the same pipeline stages and the same &
+ * flag. A corpus
+ * directory is replayed one file at a time and any mismatch aborts.
+ *
+ * Built with -DLIBFUZZER (and -fsanitize=fuzzer) the same check is
+ * the libFuzzer entry point instead, and the corpus seeds it.
+ *
+ * The shell is compiled into this program (with its main renamed) so
+ * that its routines can be called directly.
+ */
+#define main tsh_main
+#include "tsh.c"
+#undef main
+
+#include <dirent.h>
+
+/* requote - Write argv back as a line that must tokenize to the same words */
+static char *requote(char **argv, int bg)
+{
+    size_t len = 3;
+    char *line, *p, *s;
+    int i;
+
+    for (i = 0; argv[i] != NULL; i++)
+	len += 4 * strlen(argv[i]) + 3;
+    if ((p = line = malloc(len)) == NULL)
+	unix_error("malloc error");
+    for (i = 0; argv[i] != NULL; i++) {
+	if (argv[i] == pipeop || ISREDIROP(argv[i])) {
+	    p = stpcpy(p, argv[i]);
+	}
+	else {
+	    *p++ = '\'';
+	    for (s = argv[i]; *s != '\0'; s++) {
+		if (*s == '\'') {	/* ' becomes '\'' */
+		    memcpy(p, "'\\''", 4);
+		    p += 4;
+		}
+		else
+		    *p++ = *s;
+	    }
+	    *p++ = '\'';
+	}
+	*p++ = ' ';
+    }
+    if (bg)
+	*p++ = '&';
+    strcpy(p, "\n");
+    return line;
+}
+
+/* checkline - Tokenize a line twice and abort if the two disagree */
+static void checkline(const char *line)
+{
+    char **av, **words, *again;
+    int *st, bg, bg2, n, i;
+
+    if ((bg = parseline(line, &av)) < 0)
+	return;
+    for (n = 0; av[n] != NULL; n++)
+	;
+    /* the argv array and its words are reused by the next parseline */
+    if ((words = malloc((n + 1) * sizeof(char *))) == NULL)
+	unix_error("malloc error");
+    for (i = 0; i < n; i++)
+	words[i] = av[i] == pipeop || ISREDIROP(av[i]) ? av[i] : strdup(av[i]);
+    words[n] = NULL;
+    splitpipeline(av, &st);
+
+    again = requote(words, bg);
+    if ((bg2 = parseline(again, &av)) != bg) {
+	fprintf(stderr, "fuzzparse: & flag %d, then %d, for: %s", bg, bg2, again);
+	abort();
+    }
+    for (i = 0; i <= n; i++) {
+	if (words[i] == NULL ? av[i] != NULL :
+	    av[i] == NULL || (words[i] == pipeop) != (av[i] == pipeop) ||
+	    strcmp(words[i], av[i]) != 0) {
+	    fprintf(stderr, "fuzzparse: word %d differs after requoting: %s", i, again);
+	    abort();
+	}
+    }
+    splitpipeline(av, &st);
+
+    for (i = 0; i < n; i++)
+	if (words[i] != pipeop && !ISREDIROP(words[i]))
+	    free(words[i]);
+    free(words);
+    free(again);
+}
+
+#ifdef LIBFUZZER
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    char *line;
+
+    if ((line = malloc(size + 1)) == NULL)
+	unix_error("malloc error");
+    memcpy(line, data, size);
+    line[size] = '\0';
+    checkline(line);
+    free(line);
+    return 0;
+}
+#else
+
+/* replay - Check the line in one corpus file */
+static void replay(char *path)
+{
+    FILE *fp;
+    char *line;
+    long size;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	unix_error(path);
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if ((line = malloc(size + 1)) == NULL)
+	unix_error("malloc error");
+    line[fread(line, 1, size, fp)] = '\0';
+    fclose(fp);
+    checkline(line);
+    free(line);
+}
+
+int main(int argc, char **argv)
+{
+    char path[4096];
+    struct dirent *de;
+    DIR *dir;
+    int i, n = 0;
+
+    if (argc < 2) {
+	fprintf(stderr, "Usage: %s <file or directory>...\n", argv[0]);
+	exit(1);
+    }
+    for (i = 1; i < argc; i++) {
+	if ((dir = opendir(argv[i])) == NULL) {
+	    replay(argv[i]);
+	    n++;
+	    continue;
+	}
+	while ((de = readdir(dir)) != NULL) {
+	    if (de->d_name[0] == '.')
+		continue;
+	    snprintf(path, sizeof(path), "%s/%s", argv[i], de->d_name);
+	    replay(path);
+	    n++;
+	}
+	closedir(dir);
+    }
+    printf("fuzzparse: %d inputs, all round trips matched\n", n);
+    exit(0);
+}
+#endif
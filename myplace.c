@@ -0,0 +1,73 @@
+/* 
+ * myplace.c - Another handy program for testing your tiny shell 
+ * 
+ * usage: myplace [cpus] [as] [cputime] [nofile] [nice] [sched] [sleep <n>]...
+ * Prints the CPUs it may run on (from sched_getaffinity), its soft
+ * resource limits, its nice value and its scheduling policy, one item
+ * per argument, on one line. sleep <n> waits <n> seconds first.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+int main(int argc, char **argv) 
+{
+    cpu_set_t set;
+    struct rlimit rl;
+    int i, cpu, res;
+    char *sep, *comma;
+
+    for (i = 1, sep = ""; i < argc; i++) {
+	if (strcmp(argv[i], "sleep") == 0 && i + 1 < argc) {
+	    sleep(atoi(argv[++i]));
+	    continue;
+	}
+	printf("%s%s ", sep, argv[i]);
+	sep = " ";
+	if (strcmp(argv[i], "cpus") == 0) {
+	    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+		perror("sched_getaffinity");
+		exit(1);
+	    }
+	    for (cpu = 0, comma = ""; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &set)) {
+		    printf("%s%d", comma, cpu);
+		    comma = ",";
+		}
+	    continue;
+	}
+	if (strcmp(argv[i], "nice") == 0) {
+	    errno = 0;
+	    printf("%d", getpriority(PRIO_PROCESS, 0));
+	    continue;
+	}
+	if (strcmp(argv[i], "sched") == 0) {
+	    res = sched_getscheduler(0);
+	    printf("%s", res == SCHED_BATCH ? "batch" : res == SCHED_IDLE ? "idle" :
+		   res == SCHED_OTHER ? "other" : "realtime");
+	    continue;
+	}
+	if (strcmp(argv[i], "as") == 0)
+	    res = RLIMIT_AS;
+	else if (strcmp(argv[i], "cputime") == 0)
+	    res = RLIMIT_CPU;
+	else if (strcmp(argv[i], "nofile") == 0)
+	    res = RLIMIT_NOFILE;
+	else {
+	    fprintf(stderr, "Usage: %s [cpus] [as] [cputime] [nofile] [nice] [sched] [sleep <n>]...\n", argv[0]);
+	    exit(1);
+	}
+	getrlimit(res, &rl);
+	if (rl.rlim_cur == RLIM_INFINITY)
+	    printf("unlimited");
+	else
+	    printf("%llu", (unsigned long long)rl.rlim_cur);
+    }
+    printf("\n");
+    exit(0);
+}
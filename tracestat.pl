@@ -0,0 +1,48 @@
+#!/usr/bin/perl
+use JSON::PP;
+
+#######################################################################
+# tracestat.pl - Summarize a tsh lifecycle trace
+#
+# Reads the Chrome trace JSON written by "tsh -t <file>" and prints
+# the number and mean duration of parse and fork calls, of the time
+# from the shell calling fork to the child calling exec, and of the
+# lifetime of jobs.
+#
+# Usage: tracestat.pl <trace.json>
+#######################################################################
+
+local $/;
+my $t = decode_json(<>);
+my (%begin, %n, %sum, %forked, %exec);
+
+sub add { $n{$_[0]}++; $sum{$_[0]} += $_[1]; }
+
+for my $e (@{$t->{traceEvents}}) {
+    my ($name, $ph, $ts) = ($e->{name}, $e->{ph}, $e->{ts});
+    if ($ph eq "B") {
+	$begin{"$name/$e->{tid}"} = $ts;
+    }
+    elsif ($ph eq "E") {
+	add($name, $ts - $begin{"$name/$e->{tid}"});
+	$forked{$e->{args}{child}} = $begin{"$name/$e->{tid}"} if $name eq "fork";
+    }
+    elsif ($name eq "exec") {
+	$exec{$e->{tid}} = $ts;	# may come before the fork has returned
+    }
+    elsif ($ph eq "b") {
+	$begin{"job/$e->{id}"} = $ts;
+    }
+    elsif ($ph eq "e" && exists $begin{"job/$e->{id}"}) {
+	add("job", $ts - $begin{"job/$e->{id}"});
+    }
+}
+
+for my $pid (keys %exec) {
+    add("fork-to-exec", $exec{$pid} - $forked{$pid}) if exists $forked{$pid};
+}
+
+for my $k ("parse", "fork", "fork-to-exec", "job") {
+    printf "%-13s %6d events, mean %9.1f us\n", $k, $n{$k}, $sum{$k} / $n{$k}
+	if $n{$k};
+}
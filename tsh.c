@@ -9,6 +9,7 @@
  * ############################################################******************************************################################################################>
  *
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -17,20 +18,66 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/times.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <math.h>
 
 /* Misc manifest constants */
-#define MAXLINE    1024   /* max line size */
-#define MAXARGS     128   /* max args on a command line */
-#define MAXJOBS      16   /* max jobs at any point in time */
-#define MAXJID    1<<16   /* max job ID */
+#define MAXLINE    1024   /* initial line buffer size */
+#define MINJOBS      16   /* initial size of the job table */
+#define HASHSIZE    128   /* buckets in the command path cache */
+#define PLANMAX     256   /* default number of lines in the plan cache */
+#define BUILTINHASH 128   /* slots in the builtin lookup table (a power of 2) */
+#define BATCHBUF  65536   /* read and output buffer size in batch mode */
+#define MAXDONE      64   /* finished jobs remembered for the times builtin */
+#define MAXNOTICE    64   /* background job notices held until the prompt */
+#define TRACEBUF  65536   /* events kept by the lifecycle tracer (-t) */
+#define LAUNCHMAX 65536   /* largest request sent to the launcher (-z) */
+#define NLIMITS       3   /* resource limits that limit can set */
+#define MINVARS     256   /* initial buckets of the variable table */
+#define CAPSIZE   65536   /* default ring size of a captured job's output */
+#define HISTTAIL   1024   /* history lines indexed before they are sorted in */
+#define HISTBLK      64   /* sorted history lines per newest-entry block */
+#define HISTSCAN    256   /* newest history lines searched before the index */
+#define BENCHMAX 1000000  /* most runs that bench keeps timings for */
+
+#ifndef P_PIDFD
+#define P_PIDFD 3                               /* waitid() on a pidfd */
+#endif
+#ifndef CLONE_PARENT
+#define CLONE_PARENT 0x00008000
+#endif
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1UL << 2)   /* Linux 6.9 */
+#endif
 
 /* Job states */
 #define UNDEF 0 /* undefined */
 #define FG 1    /* running in foreground */
 #define BG 2    /* running in background */
 #define ST 3    /* stopped */
+#define QU 4    /* queued, waiting to be admitted */
 
 /* 
  * Jobs states: FG (foreground), BG (background), ST (stopped)
@@ -39,23 +86,363 @@
  *     ST -> FG  : fg command
  *     ST -> BG  : bg command
  *     BG -> FG  : fg command
+ *     QU -> BG  : admitted, or bg command
+ *     QU -> FG  : fg command
  * At most 1 job can be in the FG state.
+ *
+ * A job is a pipeline of one or more processes that share a process
+ * group. The job is stopped once every process that has not yet
+ * exited is stopped, and it is deleted when the last one is reaped.
  */
 
 /* Global variables */
 extern char **environ;      /* defined in libc */
 char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
 int verbose = 0;            /* if true, print additional output */
-int nextjid = 1;            /* next job ID to allocate */
+int usespawn = 0;           /* if true, launch jobs with posix_spawn */
+struct attr_t defattr;      /* placement and limits set by pin and limit */
+int bgpolicy = -1;          /* scheduling policy of background jobs, or -1 */
+int bgnice;                 /* ... and how much nicer they run (bgsched) */
+int launchfd = -1;          /* socket to the launcher (-z), or -1 */
+pid_t launchpid;            /* the launcher's PID */
+int exitstatus = 0;         /* exit status of the last builtin or foreground job */
+volatile sig_atomic_t intr; /* ctrl-c typed (cleared by the builtin that watches it) */
 char sbuf[MAXLINE];         /* for composing sprintf messages */
 
+struct proc_t {             /* A process in a job */
+    pid_t pid;              /* process ID */
+    int done;               /* has it been reaped? */
+    int stopped;            /* is it stopped? */
+    int status;             /* wait status once reaped */
+    int pidfd;              /* pidfd watched for its exit, or -1 */
+    struct job_t *job;      /* the job it belongs to */
+    struct proc_t *next;    /* next process in PID bucket */
+};
+
+struct redir_t {            /* A redirection of a command in a pipeline */
+    int stage;              /* which command */
+    int fd;                 /* the fd it replaces: 0, 1 or 2 */
+    int flags;              /* open() flags for file */
+    char *file;             /* the file, or NULL for 2>&1 */
+};
+
+struct attr_t {             /* Where and how a job runs, and its limits */
+    int flags;              /* A_CPUS, A_SPREAD, A_SCHED and the A_LIMIT bits */
+    cpu_set_t cpus;         /* with A_CPUS, the CPUs it may run on */
+    int cpu;                /* the one CPU it was spread to, or -1 */
+    int nice;               /* with A_SCHED, its nice value ... */
+    int policy;             /* ... and scheduling policy */
+    rlim_t lim[NLIMITS];    /* soft limits, in the order of limits[] */
+};
+#define A_CPUS    1         /* run on the CPUs in cpus */
+#define A_SPREAD  2         /* give each background job one CPU */
+#define A_SCHED   4         /* run with nice and policy */
+#define A_LIMIT   8         /* first limit bit: A_LIMIT << i sets lim[i] */
+
 struct job_t {              /* The job struct */
-    pid_t pid;              /* job PID */
+    pid_t pid;              /* job PID (process group ID) */
     int jid;                /* job ID [1, 2, ...] */
+    int serial;             /* jobs added before it, plus 1: never reused */
     int state;              /* UNDEF, BG, FG, or ST */
-    char cmdline[MAXLINE];  /* command line */
+    char *cmdline;          /* command line */
+    size_t cmdcap;          /* bytes allocated for cmdline */
+    struct proc_t *procs;   /* processes in pipeline order */
+    int nprocs;             /* number of processes */
+    int nlive;              /* processes not yet reaped */
+    int proccap;            /* slots allocated in procs */
+    int group;              /* parallel run it belongs to, or 0 */
+    int pidfd;              /* pidfd of the group leader, or -1 */
+    struct rusage ru;       /* resources used by its reaped processes */
+    struct timespec start;  /* when it was started */
+    struct timespec stop;   /* when it last stopped */
+    struct attr_t attr;     /* its placement, priority and limits */
+    int nice;               /* its own nice value (renice) */
+    struct capture_t *cap;  /* its captured output, or NULL */
+    char **qvec;            /* queued job: argv of each command, NULL
+                               terminated, followed by their paths and
+                               its NAME=value words */
+    int qveccap;            /* slots allocated in qvec */
+    char *qbuf;             /* queued job: storage for the strings */
+    size_t qbufcap;         /* bytes allocated for qbuf */
+    int qstages;            /* queued job: number of commands */
+    int qnassign;           /* queued job: number of NAME=value words */
+    struct redir_t *qredir; /* queued job: its redirections */
+    int qnredir;            /* queued job: number of redirections */
+    int qredircap;          /* slots allocated in qredir */
+    struct job_t *qnext;    /* next job in the admission queue */
+    struct job_t *qprev;    /* previous job in the admission queue */
+    struct job_t *next;     /* next job on the free list */
+};
+
+/*
+ * The job table. Jobs are found by JID through a directly indexed
+ * array and by PID through a chained hash table of their processes,
+ * so every lookup is O(1) however many jobs are live. Deleted job
+ * structs are kept on a free list (with their cmdline and procs
+ * buffers) and reused by addjob, so the SIGCHLD handler never has to
+ * call free(). The tables only grow, and only from addjob and
+ * addproc.
+ */
+struct jobtab_t {
+    struct job_t **byjid;   /* jobs indexed by JID, byjid[0] unused */
+    int jidcap;             /* number of slots in byjid */
+    int maxjid;             /* largest allocated JID */
+    int nadded;             /* jobs added so far */
+    struct proc_t **bypid;  /* PID hash buckets */
+    int pidcap;             /* number of buckets (a power of 2) */
+    int njobs;              /* number of jobs in the table */
+    int nprocs;             /* number of unreaped processes */
+    int nreserved;          /* PID hash slots reserved by queued jobs */
+    int nuntracked;         /* unreaped processes without a pidfd */
+    int nbg;                /* number of jobs in the BG state */
+    struct job_t *fg;       /* the foreground job, or NULL */
+    struct job_t *free;     /* recycled job structs */
+};
+struct jobtab_t jobs;       /* The job list */
+
+struct jobstat_t {          /* Resource usage of a finished job */
+    int jid;                /* its job ID */
+    pid_t pid;              /* its process group ID */
+    int status;             /* wait status of its last command */
+    int nprocs;             /* number of processes */
+    struct rusage ru;       /* resources used by all its processes */
+    struct timespec start;  /* when it was started */
+    struct timespec end;    /* when its last process was reaped */
+    char cmdline[64];       /* start of its command line */
+};
+struct jobstat_t donejobs[MAXDONE]; /* Ring of the last finished jobs */
+long ndone;                 /* number of jobs finished so far */
+
+struct notice_t {           /* A background job killed by a signal */
+    int jid;                /* its job ID */
+    pid_t pid;              /* its process group ID */
+    int sig;                /* the signal */
+};
+struct notice_t notices[MAXNOTICE]; /* Held until the next prompt or wait */
+int nnotices;               /* number of notices held */
+
+struct cmdhash_t {          /* A command path cache entry */
+    char *name;             /* command name as typed */
+    char *path;             /* absolute path found on PATH */
+    int hits;               /* times the entry was used */
+    struct cmdhash_t *next; /* next entry in the bucket */
+};
+struct cmdhash_t *cmdhash[HASHSIZE]; /* The command path cache */
+char *hashpath;             /* value of PATH the cache was filled for */
+unsigned hashgen;           /* bumped whenever cached paths are dropped */
+
+struct plan_t {             /* A command line, parsed and resolved */
+    char *line;             /* the command line (the cache key) */
+    unsigned hash;          /* hash of line */
+    int bg;                 /* run in the background? */
+    int builtin;            /* index in builtins[], or -1 */
+    int nstages;            /* number of commands in the pipeline */
+    char **argv;            /* the words, with a NULL after each command;
+                               NAME=value words and a pin or limit prefix
+                               come before argvs[0] */
+    int nassign;            /* number of NAME=value words */
+    char ***argvs;          /* first word of each command */
+    char **paths;           /* program of each command */
+    struct redir_t *redirs; /* redirections of the commands */
+    int nredirs;            /* number of redirections */
+    int searched;           /* was a path found on PATH? */
+    unsigned gen;           /* hashgen when the paths were found */
+    unsigned vgen;          /* vars.gen when its variables were expanded,
+                               or 0 if it has none */
+    int refs;               /* held by the cache and by running evals */
+    long hits;              /* times it was reused */
+    struct plan_t *hnext;   /* next plan in the bucket */
+    struct plan_t *prev;    /* LRU list neighbours, most recent first */
+    struct plan_t *next;
+};
+
+/*
+ * The plan cache maps a raw command line to its plan, so that a line
+ * that is run again goes straight to launchjob (or to its builtin)
+ * without being parsed or looked up on PATH. It holds at most max
+ * plans and evicts the least recently used one. A plan and all its
+ * strings are a single allocation.
+ */
+struct plancache_t {
+    struct plan_t **buckets; /* hash buckets */
+    int nbuckets;           /* number of buckets (a power of 2) */
+    struct plan_t *head;    /* most recently used plan */
+    struct plan_t *tail;    /* least recently used plan */
+    int n;                  /* plans in the cache */
+    int max;                /* most plans kept, 0 to cache nothing */
+    long hits, misses, evictions;
+} plans = { .max = PLANMAX };
+
+struct builtin_t {          /* A builtin command */
+    char *name;             /* its name */
+    void (*fn)(char **argv); /* the routine that runs it */
+};
+
+struct parallel_t {         /* The running parallel builtin */
+    int id;                 /* group of its jobs, 0 if none is running */
+    volatile int running;   /* jobs started and not yet finished */
+    volatile int done;      /* jobs finished */
+    volatile int failed;    /* jobs that did not exit with status 0 */
+    volatile sig_atomic_t intr; /* ctrl-c was typed */
+    int n;                  /* jobs to keep running at once */
+    char **lines;           /* the command lines to run */
+    int nlines;             /* how many there are */
+    int next;               /* the next one to start */
+    int started;            /* jobs started */
+    int nostart;            /* lines that could not be started */
+    int killed;             /* ctrl-c was relayed to the jobs */
+    struct timespec t0;     /* when the run began */
+} par;
+
+/* Admission modes */
+#define ADMIT_OFF   0       /* start every job at once */
+#define ADMIT_FIXED 1       /* at most base running background jobs */
+#define ADMIT_CPUS  2       /* at most one per online CPU */
+#define ADMIT_PSI   3       /* base, scaled down by CPU pressure */
+
+struct admit_t {            /* Admission control for background jobs */
+    int mode;               /* ADMIT_OFF, ADMIT_FIXED, ... */
+    int base;               /* configured limit */
+    double psi;             /* last CPU pressure read (some avg10, %) */
+    time_t psitime;         /* when psi was read */
+    struct job_t *head;     /* FIFO of queued jobs */
+    struct job_t *tail;
+    int nqueued;            /* jobs in the queue */
+    int peak;               /* most background jobs seen running */
+    long submitted;         /* background jobs queued */
+    long admitted;          /* jobs started from the queue */
+} admit;
+
+/* Lifecycle trace events */
+#define EV_PARSE    0       /* parsing a command line (begin/end) */
+#define EV_FORK     1       /* fork or posix_spawn call (begin/end) */
+#define EV_EXEC     2       /* child about to exec (recorded by the child) */
+#define EV_SETPGID  3       /* parent put a child in its group */
+#define EV_JOB      4       /* job lifetime (async begin at add, end at delete) */
+#define EV_RELAY    5       /* signal relayed to a process group */
+#define EV_REAP     6       /* child reaped or stopped */
+#define EV_WAKE     7       /* waitfg woke up */
+#define NEVENTS     8
+
+struct tevent_t {           /* A trace event */
+    long ts;                /* CLOCK_MONOTONIC time in ns */
+    short type;             /* EV_PARSE, ... */
+    char ph;                /* Chrome trace phase: 'B', 'E', 'i', 'b', 'e' */
+    pid_t tid;              /* process that recorded it */
+    int arg[3];             /* event arguments */
+};
+
+struct tracebuf_t {         /* Ring of trace events, shared with children */
+    unsigned long next;     /* events recorded so far */
+    struct tevent_t ev[TRACEBUF];
+};
+struct tracebuf_t *tracebuf; /* The trace ring, NULL unless tracing */
+char *tracefile;            /* where the trace is written at exit */
+pid_t tracepid;             /* PID of the process recording events */
+pid_t shellpid;             /* PID of the shell */
+
+/*
+ * The shell keeps SIGCHLD, SIGINT and SIGTSTP blocked and takes them
+ * from a signalfd, which is watched by epoll along with the terminal.
+ * Their "handlers" run from the event loop, in normal context. Each
+ * child also has a pidfd in the epoll set, which reports its exit.
+ */
+int sigfd = -1;             /* signalfd for the signals we handle */
+int epfd = -1;              /* epoll set: sigfd, and stdin when interactive */
+int inpoll;                 /* is stdin in the epoll set? */
+int inarmed;                /* is it armed (EPOLLONESHOT)? */
+int inready;                /* has it become readable since we last read? */
+#define PIDTAG (1ULL << 32) /* epoll data of a pidfd: PIDTAG | its PID */
+#define CAPTAG (1ULL << 33) /* epoll data of a capture pipe: CAPTAG | its fd */
+
+/*
+ * With capture on, the stdout and stderr of each background job go to
+ * a pipe that the event loop drains into the job's capture: a ring of
+ * its newest output, from which the oldest bytes are spilled to an
+ * unlinked file when it is full. While the job is in the foreground
+ * its output is also written through to our stdout. A capture outlives
+ * its job until its output has been read.
+ */
+struct capture_t {          /* Captured output of a background job */
+    int jid;                /* its job's ID */
+    pid_t pid;              /* its job's process group ID */
+    struct job_t *job;      /* the job, or NULL once it has finished */
+    int fd;                 /* read end of the pipe, or -1 after its EOF */
+    int fg;                 /* write the output through to stdout too? */
+    char *buf;              /* the ring */
+    size_t size;            /* bytes in the ring */
+    size_t start;           /* offset in the output of the ring's oldest byte */
+    size_t end;             /* bytes of output captured */
+    size_t shown;           /* bytes of it printed so far */
+    int spillfd;            /* file of the bytes before start, or -1 */
+    size_t spilled;         /* bytes in that file */
+    struct capture_t *next; /* next (older) capture */
+};
+size_t capsize;             /* ring size of new captures, 0 if capture is off */
+struct capture_t *captures; /* list of captures, newest first */
+sigset_t childmask;         /* signal mask for children: the shell's initial one */
+
+/*
+ * The history is an append-only log of records: a histrec_t header,
+ * the line (without its newline) and the line's length again, so that
+ * the log can be walked from either end. Each record is appended with
+ * a single write() on an O_APPEND descriptor, so several shells can
+ * share one file. It is read through a shared mapping that grows with
+ * the file. Startup only checks the magic; the index of the lines
+ * sorted by text, for prefix searches, is built the first time one
+ * needs it and then kept up to date: new lines collect in a tail that
+ * is sorted and merged in once it holds HISTTAIL of them.
+ */
+#define HISTMAGIC "tshhist1"  /* first 8 bytes of a history file */
+
+struct histrec_t {          /* Header of a history record */
+    int64_t when;           /* when the line was run, in seconds since the epoch */
+    int32_t status;         /* its exit status */
+    uint32_t msecs;         /* how long it ran, in ms */
+    uint32_t len;           /* length of the line */
+};
+
+struct history_t {
+    int fd;                 /* the log, open for appending; -1 if there is none */
+    char *map;              /* its mapping */
+    size_t maplen;          /* bytes mapped */
+    size_t indexed;         /* the records before this offset are indexed */
+    size_t *sorted;         /* offsets of records, sorted by line then offset */
+    size_t nsorted;
+    size_t *newest;         /* the newest offset in each HISTBLK entries of sorted */
+    size_t *tail;           /* offsets of records indexed but not sorted yet */
+    size_t ntail, tailcap;
+} hist = { .fd = -1 };
+
+/*
+ * Shell variables are kept in a hash table, each as one "NAME=value"
+ * string, so that the exported ones can be put in the environment of
+ * children as they are. envp, the environment every child gets, is an
+ * array of those strings that getenvp only rebuilds after an exported
+ * variable has changed, not for every command; environ is pointed at
+ * it too, for getenv. The strings that envp may still point to are
+ * retired rather than freed until it is rebuilt.
+ */
+struct var_t {              /* A shell variable */
+    char *str;              /* "NAME=value" */
+    size_t nlen;            /* length of NAME */
+    int exported;           /* in the environment of children? */
+    struct var_t *next;     /* next variable in the bucket */
 };
-struct job_t jobs[MAXJOBS]; /* The job list */
+
+struct vartab_t {
+    struct var_t **buckets; /* hash buckets */
+    int nbuckets;           /* number of buckets (a power of 2) */
+    int n;                  /* number of variables */
+    int nexported;          /* number of them exported */
+    unsigned gen;           /* bumped whenever a variable changes */
+    char **envp;            /* the exported variables, NULL terminated */
+    int envcap;             /* slots allocated in envp */
+    int envdirty;           /* must envp be rebuilt? */
+    unsigned envgen;        /* bumped whenever envp is rebuilt */
+    char **retired;         /* strings to free when envp is rebuilt */
+    int nretired, retiredcap;
+} vars = { .gen = 1 };
 /* End global variables */
 
 
@@ -72,41 +459,216 @@ void sigtstp_handler(int sig);
 void sigint_handler(int sig);
 
 /* Here are helper routines that we've provided for you */
-int parseline(const char *cmdline, char **argv); 
+int parseline(const char *cmdline, char ***argvp); 
 void sigquit_handler(int sig);
 
 void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid); 
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid); 
+void initjobs(struct jobtab_t *jobs);
+int maxjid(struct jobtab_t *jobs); 
+struct job_t *addjob(struct jobtab_t *jobs, pid_t pid, int state, char *cmdline);
+int deletejob(struct jobtab_t *jobs, pid_t pid); 
+pid_t fgpid(struct jobtab_t *jobs);
+struct job_t *getjobpid(struct jobtab_t *jobs, pid_t pid);
+struct job_t *getjobjid(struct jobtab_t *jobs, int jid); 
 int pid2jid(pid_t pid); 
-void listjobs(struct job_t *jobs);
+void listjobs(struct jobtab_t *jobs, int stats);
+
+/* Command line parsing */
+int splitpipeline(char **argv, int **stagep);
+int splitredirs(char **argv, int *stage, int nstages, struct redir_t **redirp);
+
+/* Starting jobs: placement, scheduling, redirections and the launcher */
+struct job_t *startjob(char **argv, int *stage, int nstages, struct redir_t *redirs, int nredirs, char *cmdline, int state, sigset_t *mask);
+struct job_t *launchjob(struct job_t *job, char ***argvs, char **paths, struct redir_t *redirs, int nredirs, int nstages, char *cmdline, int state, sigset_t *mask, struct attr_t *attr, char **envp);
+pid_t launch(char *path, char **argv, char **envp, sigset_t *mask, pid_t pgid, int in, int out, int err, struct attr_t *attr);
+pid_t launchvia(char *path, char **argv, char **envp, sigset_t *mask, pid_t pgid, int in, int out, int err, struct attr_t *attr);
+static void waitexec(int *sync);
+
+int parseattr(char **argv, struct attr_t *a);
+int spreadcpu(struct attr_t *a);
+void applyattr(struct attr_t *a);
+void printattr(struct attr_t *a);
+void wantsched(struct attr_t *a, int state, int nice);
+int schedjob(struct job_t *job);
+
+void startlauncher(void);
+void stoplauncher(void);
+
+int openredirs(struct redir_t *redirs, int nredirs, int stage, int *fds);
+void closeredirs(int *fds);
+
+/* Builtin commands */
+void runbuiltin(struct plan_t *plan);
+int findbuiltin(char *name);
+void timecmd(char *cmdline);
+void benchcmd(char *cmdline);
+
+void do_quit(char **argv);
+void do_jobs(char **argv);
+void do_hash(char **argv);
+void do_parallel(char **argv);
+void dispatchpar(void);
+void do_admit(char **argv);
+void do_times(char **argv);
+void do_plan(char **argv);
+void do_echo(char **argv);
+void do_true(char **argv);
+void do_false(char **argv);
+void do_printf(char **argv);
+void do_cd(char **argv);
+void do_pwd(char **argv);
+void do_kill(char **argv);
+void do_wait(char **argv);
+void do_test(char **argv);
+void do_cat(char **argv);
+void do_place(char **argv);
+void do_bgsched(char **argv);
+void do_renice(char **argv);
+void do_history(char **argv);
+void do_capture(char **argv);
+void do_output(char **argv);
+void do_export(char **argv);
+void do_unset(char **argv);
+
+/* Job list */
+int addproc(struct jobtab_t *jobs, struct job_t *job, pid_t pid);
+void freejob(struct jobtab_t *jobs, struct job_t *job);
+void deleteproc(struct jobtab_t *jobs, struct proc_t *proc);
+void setjobstate(struct jobtab_t *jobs, struct job_t *job, int state);
+struct proc_t *getprocpid(struct jobtab_t *jobs, pid_t pid);
+void stopproc(struct proc_t *p, int stat);
+void reapproc(struct proc_t *p, int stat, struct rusage *ru);
+
+/* Job resource usage */
+double tsdiff(struct timespec *a, struct timespec *b);
+double tvsecs(struct timeval *tv);
+void addrusage(struct rusage *total, struct rusage *ru);
+void printrusage(struct rusage *ru);
+void savejobstat(struct job_t *job, int status);
+void notejob(struct job_t *job, int sig);
+void flushnotices(void);
+
+/* Command path and plan caches */
+char *findcmd(char *name);
+void clearhash(void);
+
+struct plan_t *getplan(char *cmdline);
+void putplan(struct plan_t *plan);
+void clearplans(void);
+
+/* Admission control */
+struct job_t *queuejob(char ***argvs, char **paths, struct redir_t *redirs, int nredirs, int nstages, char *cmdline, struct attr_t *attr, char **assigns, int nassign);
+int admitjob(struct job_t *job, int state, sigset_t *mask);
+int admitlimit(void);
+void admitjobs(void);
+void drainjobs(int all);
+
+/* Shell variables */
+void initvars(void);
+char *getvar(const char *name, size_t len);
+void setvar(const char *name, size_t len, const char *value, int export);
+void unsetvar(const char *name);
+int namelen(const char *s);
+int assignlen(char *word);
+int nassigns(char **argv);
+void assignvars(char **argv);
+char **getenvp(void);
+char **cmdenv(char **env, char **assigns, int n);
 
+/* Output capture */
+struct capture_t *newcapture(int *wfd);
+void drainall(struct capture_t *c);
+void showcapture(struct capture_t *c, size_t from);
+void freecapture(struct capture_t *c);
+struct capture_t *getcapture(int jid, pid_t pid);
+void drainfd(int fd);
+
+/* Command history */
+void inithist(char *file);
+static void trimhist(void);
+void addhist(char *line, int status, long msecs);
+size_t findhist(char *prefix, size_t len);
+void listhist(long count, char *prefix, int full);
+void runhist(char *line);
+
+/* Command input and events */
+void runinput(int fd, int interactive, int emit_prompt);
+void initevents(void);
+int waitevent(int wantinput, int timeout);
+void handlesignals(void);
+void trackproc(struct job_t *job, pid_t pid);
+void reapchild(pid_t pid);
+int signaljob(struct job_t *job, int sig);
+
+/* Lifecycle tracing */
+void inittrace(char *file);
+void traceevent(int type, int ph, int a, int b);
+void tracejob(int ph, struct job_t *job);
+void dumptrace(void);
+
+/* Other helper routines */
 void usage(void);
 void unix_error(char *msg);
 void app_error(char *msg);
 typedef void handler_t(int);
 handler_t *Signal(int signum, handler_t *handler);
 
+/*
+ * The builtin commands, found by findbuiltin by their bare names. A
+ * command named by a path (/bin/echo) is always the program.
+ */
+struct builtin_t builtins[] = {
+    { "quit", do_quit },
+    { "jobs", do_jobs },
+    { "fg", do_bgfg },
+    { "bg", do_bgfg },
+    { "hash", do_hash },
+    { "parallel", do_parallel },
+    { "admit", do_admit },
+    { "times", do_times },
+    { "plan", do_plan },
+    { "echo", do_echo },
+    { "true", do_true },
+    { "false", do_false },
+    { "printf", do_printf },
+    { "cd", do_cd },
+    { "pwd", do_pwd },
+    { "kill", do_kill },
+    { "wait", do_wait },
+    { "test", do_test },
+    { "[", do_test },
+    { "cat", do_cat },
+    { "pin", do_place },
+    { "limit", do_place },
+    { "bgsched", do_bgsched },
+    { "renice", do_renice },
+    { "history", do_history },
+    { "capture", do_capture },
+    { "output", do_output },
+    { "export", do_export },
+    { "unset", do_unset },
+};
+#define NBUILTINS (int)(sizeof(builtins) / sizeof(builtins[0]))
+_Static_assert(3 * NBUILTINS <= BUILTINHASH, "findbuiltin keeps its table at most a third full");
+
 /*
  * main - The shell's main routine 
  */
 int main(int argc, char **argv) 
 {
     char c;
-    char cmdline[MAXLINE];
     int emit_prompt = 1; /* emit prompt (default) */
+    int batchfd = -1;    /* script to run in batch mode */
+    char *histfile = NULL; /* history log */
+    char path[4096];
+    struct stat st;
 
     /* Redirect stderr to stdout (so that driver will get all output
      * on the pipe connected to stdout) */
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
+    while ((c = getopt(argc, argv, "hvpszf:t:H:")) != EOF) {
         switch (c) {
         case 'h':             /* print help message */
             usage();
@@ -117,589 +679,5987 @@ int main(int argc, char **argv)
         case 'p':             /* don't print a prompt */
             emit_prompt = 0;  /* handy for automatic testing */
 	    break;
+        case 's':             /* launch jobs with posix_spawn */
+            usespawn = 1;
+	    break;
+        case 'z':             /* launch jobs through a launcher process */
+            launchfd = 0;
+	    break;
+        case 'f':             /* run a script in batch mode */
+            if ((batchfd = open(optarg, O_RDONLY | O_CLOEXEC)) < 0)
+		unix_error(optarg);
+	    break;
+        case 't':             /* record a lifecycle trace */
+            inittrace(optarg);
+	    break;
+        case 'H':             /* keep the command history in this file */
+            histfile = optarg;
+	    break;
 	default:
             usage();
 	}
     }
 
-    /* Install the signal handlers */
+    /* The environment becomes the exported shell variables */
+    initvars();
+
+    /* Fork the launcher now, while the shell is small */
+    if (launchfd == 0)
+	startlauncher();
 
-    /* These are the ones you will need to implement */
-    Signal(SIGINT,  sigint_handler);   /* ctrl-c */
-    Signal(SIGTSTP, sigtstp_handler);  /* ctrl-z */
-    Signal(SIGCHLD, sigchld_handler);  /* Terminated or stopped child */
+    /* Take ctrl-c, ctrl-z and child events from the event loop */
+    initevents();
 
     /* This one provides a clean way to kill the shell */
     Signal(SIGQUIT, sigquit_handler); 
 
     /* Initialize the job list */
-    initjobs(jobs);
+    initjobs(&jobs);
 
-    /* Execute the shell's read/eval loop */
-    while (1) {
+    /* Scripts (-f, or a regular file on stdin) run in batch mode */
+    if (batchfd < 0 && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode))
+	batchfd = STDIN_FILENO;
 
-	/* Read command line */
-	if (emit_prompt) {
-	    printf("%s", prompt);
-	    fflush(stdout);
-	}
-	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-	    app_error("fgets error");
-	if (feof(stdin)) { /* End of file (ctrl-d) */
-	    fflush(stdout);
-	    exit(0);
-	}
+    /* Keep a history of the lines typed at a terminal, or as -H says */
+    if (histfile == NULL && batchfd < 0 && emit_prompt && isatty(STDIN_FILENO) &&
+	getenv("HOME") != NULL) {
+	snprintf(path, sizeof(path), "%s/.tsh_history", getenv("HOME"));
+	histfile = path;
+    }
+    if (histfile != NULL)
+	inithist(histfile);
 
-	/* Evaluate the command line */
-	eval(cmdline);
-	fflush(stdout);
-	fflush(stdout);
-    } 
+    /* Execute the shell's read/eval loop */
+    if (batchfd >= 0)
+	runinput(batchfd, 0, 0);
+    else
+	runinput(STDIN_FILENO, 1, emit_prompt);
 
-    exit(0); /* control never reaches here */
+    /* End of file (ctrl-d) */
+    drainjobs(0);     /* don't lose jobs still waiting to be admitted */
+    fflush(stdout);
+    exit(0);
 }
   
+/*
+ * lineprefix - If the first word of line is word (unquoted), return
+ *    the rest of the line after it, else NULL
+ */
+static char *lineprefix(char *line, char *word)
+{
+    size_t len = strlen(word);
+
+    line += strspn(line, " \t");
+    if (strncmp(line, word, len) != 0 || strchr(" \t\r\n", line[len]) == NULL)
+	return NULL;
+    return line + len;
+}
+
 /* 
  * eval - Evaluate the command line that the user has just typed in
  * 
  * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
- * the foreground, wait for it to terminate and then return.  Note:
- * each child process must have a unique process group ID so that our
- * background children don't receive SIGINT (SIGTSTP) from the kernel
- * when we type ctrl-c (ctrl-z) at the keyboard.  
+ * then execute it immediately. Otherwise, fork a child process for
+ * each command of the pipeline and run the job in the context of the
+ * children. If the job is running in the foreground, wait for it to
+ * terminate and then return.  Note: each job must have a unique
+ * process group ID so that our background children don't receive
+ * SIGINT (SIGTSTP) from the kernel when we type ctrl-c (ctrl-z) at
+ * the keyboard. All processes of a pipeline share the group of the
+ * first one, so job control acts on the pipeline as a whole.
 */
 void eval(char *cmdline) 
 {
-    char *argv[MAXARGS];
-    pid_t pid;
-    int bg=parseline(cmdline,argv);
-    sigset_t s;
-    sigemptyset(&s);
-    sigaddset(&s, SIGCHLD);                                 					/* Add sigchild to the sigset to be blocked */
-    if(bg!=-1){											/* Ignoring Blank Lines */
-		if(!builtin_cmd(argv)){								/* Cheking if the command is builtin or not */				
-                		sigprocmask(SIG_BLOCK, &s, 0);					/* Block the sigset s containing SIGCHLD */
-				if((pid=fork())==0){
-					/* Child */
-					setpgid(0,0);			/* Making a Process Group with Child's Process ID and making child the leader of the group */
-					sigprocmask(SIG_UNBLOCK, &s, 0);			/* Unblocking the sigset in child */
-                    			execvp(argv[0],argv);
-					printf("%s: Command not found\n",argv[0]);
-					fflush(stdout);
-					exit(0);
-				}else{
-					/* Parent */
-					sigprocmask(SIG_UNBLOCK, &s, 0);                        /* Unblocking the sigset in parent */
-                    			if(bg){
-						addjob(jobs,pid,BG,cmdline);			/* Adding the job to the Background */
-						printf("[%d] (%d) %s",pid2jid(pid),pid,cmdline);
-						fflush(stdout);
-					}else{
-						addjob(jobs,pid,FG,cmdline);			/* Adding the job to the foreground */
-						waitfg(pid);					/* Waiting for foreground process to finish */
+    struct plan_t *plan;
+    struct job_t *job;
+    struct attr_t attr;
+    char **envp,*rest;
+    if((rest=lineprefix(cmdline,"time"))!=NULL){						/* time and bench wrap the rest of the line */
+	timecmd(rest);
+	return;
+    }
+    if((rest=lineprefix(cmdline,"bench"))!=NULL){
+	benchcmd(rest);
+	return;
+    }
+    traceevent(EV_PARSE,'B',0,0);
+    plan=getplan(cmdline);									/* Parsed and resolved, or reused from the plan cache */
+    traceevent(EV_PARSE,'E',plan?plan->bg:-1,0);
+    if(plan==NULL)										/* Ignoring Blank Lines (and syntax errors, unknown commands) */
+	return;
+    if(plan->argvs[0][0]==NULL){								/* NAME=value ...: set shell variables */
+	assignvars(plan->argv);
+	exitstatus=0;
+	putplan(plan);
+	return;
+    }
+    if(plan->builtin>=0){									/* Builtins run at once (NAME=value before one is ignored) */
+	exitstatus=0;										/* ... and set it only when they fail */
+	runbuiltin(plan);
+	putplan(plan);
+	return;
+    }
 
-					}
-				}
-		}
+    attr=defattr;
+    if(plan->argvs[0]!=plan->argv+plan->nassign)						/* A pin or limit prefix, checked by makeplan */
+	parseattr(plan->argv+plan->nassign,&attr);
+    char *env[plan->nassign?vars.nexported+plan->nassign+1:1];
+    envp=plan->nassign?cmdenv(env,plan->argv,plan->nassign):getenvp();			/* NAME=value words are for this command only */
+    fflush(stdout);										/* Our output goes before the job's */
+    if(plan->bg && admit.mode!=ADMIT_OFF){							/* Background jobs wait for a free slot */
+	job=queuejob(plan->argvs,plan->paths,plan->redirs,plan->nredirs,plan->nstages,cmdline,&attr,plan->argv,plan->nassign);
+	admitjobs();
+	if(job->state==QU)
+		printf("[%d] (queued) %s",job->jid,cmdline);
+	else
+		printf("[%d] (%d) %s",job->jid,job->pid,cmdline);
+	fflush(stdout);
+    }else if((job=launchjob(NULL,plan->argvs,plan->paths,plan->redirs,plan->nredirs,plan->nstages,cmdline,plan->bg?BG:FG,&childmask,&attr,envp))==NULL){
+	;											/* Nothing was started */
+    }else if(plan->bg){
+	printf("[%d] (%d) %s",job->jid,job->pid,cmdline);
+	fflush(stdout);
+    }else{
+	waitfg(job->pid);								/* Waiting for foreground job to finish */
     }
+    putplan(plan);
     return;
 }
 
-/* 
- * parseline - Parse the command line and build the argv array.
- * 
- * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.  
+/*
+ * startjob - Start the pipeline whose commands begin at argv[stage[0]],
+ *    ..., argv[stage[nstages-1]], with the redirections redirs, as a
+ *    new job in state state, and return the job, or NULL if no process
+ *    was started. mask is the signal mask to give the children. The
+ *    job is placed as pin and limit say, and as its own pin or limit
+ *    prefix says, and gets the NAME=value words before that in its
+ *    environment.
+ */
+struct job_t *startjob(char **argv, int *stage, int nstages, struct redir_t *redirs, int nredirs, char *cmdline, int state, sigset_t *mask)
+{
+    char *path[nstages];
+    char **argvs[nstages];
+    struct attr_t attr=defattr;
+    int i,pre,nassign=nassigns(&argv[stage[0]]);
+    char *env[nassign?vars.nexported+nassign+1:1];
+
+    if((pre=parseattr(&argv[stage[0]+nassign],&attr))<0)
+	return NULL;
+    pre+=nassign;
+    for(i=0;i<nstages;i++){									/* Resolve the commands before creating any process */
+	argvs[i]=&argv[stage[i]+(i==0?pre:0)];
+	if(argvs[i][0]==NULL){
+		printf("%s: no command\n",argv[stage[0]]);
+		return NULL;
+	}
+	if((path[i]=findcmd(argvs[i][0]))==NULL){
+		printf("%s: Command not found\n",argvs[i][0]);
+		return NULL;
+	}
+    }
+    return launchjob(NULL,argvs,path,redirs,nredirs,nstages,cmdline,state,mask,&attr,
+		     nassign?cmdenv(env,&argv[stage[0]],nassign):getenvp());
+}
+
+/*
+ * launchjob - Launch the commands argvs[0], ..., argvs[nstages-1]
+ *    (running the programs in paths) as a pipeline in one process
+ *    group, with the redirections redirs and the environment envp,
+ *    placed and limited as attr says. The processes are added to job,
+ *    or to a new job in state state if job is NULL. Return the job, or
+ *    NULL if no process was started.
  */
-int parseline(const char *cmdline, char **argv) 
+struct job_t *launchjob(struct job_t *job, char ***argvs, char **paths, struct redir_t *redirs, int nredirs, int nstages, char *cmdline, int state, sigset_t *mask, struct attr_t *attr, char **envp)
 {
-    static char array[MAXLINE]; /* holds local copy of command line */
-    char *buf = array;          /* ptr that traverses command line */
-    char *delim;                /* points to first space delimiter */
-    int argc;                   /* number of args */
-    int bg;                     /* background job? */
+    int i,in,out=STDOUT_FILENO,err=STDERR_FILENO,fds[2],rfds[nstages][3];
+    pid_t pid,pgid=0;
+    struct attr_t a=*attr;
+    struct capture_t *cap=NULL;
 
-    strcpy(buf, cmdline);
-    buf[strlen(buf)-1] = ' ';  /* replace trailing '\n' with space */
-    while (*buf && (*buf == ' ')) /* ignore leading spaces */
-	buf++;
+    a.cpu=-1;
+    if((a.flags&A_SPREAD) && state==BG)							/* The whole pipeline shares one CPU */
+	a.cpu=spreadcpu(&a);
+    wantsched(&a,state,job?job->nice:0);							/* Set in the child, so its own children inherit it */
 
-    /* Build the argv list */
-    argc = 0;
-    if (*buf == '\'') {
-	buf++;
-	delim = strchr(buf, '\'');
+    for(i=0;i<nstages;i++){									/* Open every file first, so a bad one starts nothing */
+	if(openredirs(redirs,nredirs,i,rfds[i])<0){
+		while(--i>=0)
+			closeredirs(rfds[i]);
+		return NULL;
+	}
     }
-    else {
-	delim = strchr(buf, ' ');
+    if(capsize>0 && state==BG && (cap=newcapture(&out))!=NULL)				/* The pipeline writes to its capture */
+	err=out;
+    in=STDIN_FILENO;
+    for(i=0;i<nstages;i++){
+	fds[1]=out;
+	if(i<nstages-1 && pipe2(fds,O_CLOEXEC)<0)					/* Close-on-exec, so children only keep the ends they dup */
+		unix_error("pipe error");
+	pid=launch(paths[i],argvs[i],envp,mask,pgid,
+		   rfds[i][0]>=0?rfds[i][0]:in,						/* A redirection replaces the pipe */
+		   rfds[i][1]>=0?rfds[i][1]:fds[1],
+		   rfds[i][2]>=0?rfds[i][2]:rfds[i][2]==-2?fds[1]:err,
+		   a.flags?&a:NULL);
+	closeredirs(rfds[i]);
+	if(in!=STDIN_FILENO)								/* The shell keeps at most the read end of one pipe */
+		close(in);
+	if(i<nstages-1){
+		close(fds[1]);
+		in=fds[0];
+	}
+	if(pid==0)
+		continue;
+	if(pgid==0){
+		pgid=pid;								/* The first process leads the group */
+		if(job==NULL)
+			job=addjob(&jobs,pid,state,cmdline);
+		else{
+			job->pid=pid;
+			addproc(&jobs,job,pid);
+		}
+		job->attr=a;
+		trackproc(job,pid);
+		clock_gettime(CLOCK_MONOTONIC,&job->start);
+		continue;
+	}
+	addproc(&jobs,job,pid);
+	trackproc(job,pid);
     }
+    if(cap!=NULL){
+	close(out);										/* Only the children write to it */
+	if(pgid){
+		cap->jid=job->jid;
+		cap->pid=job->pid;
+		cap->job=job;
+		job->cap=cap;
+	}else
+		freecapture(cap);
+    }
+    return pgid?job:NULL;
+}
 
-    while (delim) {
-	argv[argc++] = buf;
-	*delim = '\0';
-	buf = delim + 1;
-	while (*buf && (*buf == ' ')) /* ignore spaces */
-	       buf++;
+/*
+ * launch - Start the program at path with arguments argv and
+ *    environment envp in process group pgid (a new group led by the
+ *    child if pgid is 0), reading from fd in and writing to fd out,
+ *    with its errors going to fd err, and placed and limited as attr
+ *    says (if it is not NULL).
+ *    Return its PID, or 0 if no process could be started.
+ *
+ * The child runs with the signal mask <mask> (normally the mask the
+ * shell started with, so it does not inherit the signals the shell
+ * blocks to read them from its signalfd). The group is set by both the parent
+ * and the child, so it is in place before either of them goes on.
+ * By default the child is created with fork(). With -s the job is
+ * started with posix_spawn() instead, which glibc implements with
+ * clone(CLONE_VM|CLONE_VFORK): the shell's page tables are not copied,
+ * so the cost does not grow with the size of the shell, and a failed
+ * exec is reported back to us; as posix_spawn cannot set the CPUs or
+ * the limits of the child, a job with an attr is forked. With -z the
+ * request goes to the
+ * launcher (see launcher), which stays as small as the shell was at
+ * startup, and only falls back to the other two if it cannot be used.
+ */
+pid_t launch(char *path, char **argv, char **envp, sigset_t *mask, pid_t pgid, int in, int out, int err, struct attr_t *attr)
+{
+    pid_t pid;
+    posix_spawnattr_t sa;
+    posix_spawn_file_actions_t fa;
+    int rc,sync[2];
 
-	if (*buf == '\'') {
-	    buf++;
-	    delim = strchr(buf, '\'');
-	}
-	else {
-	    delim = strchr(buf, ' ');
+    if(launchfd>=0 && (pid=launchvia(path,argv,envp,mask,pgid,in,out,err,attr))>=0)
+	return pid;
+    if(usespawn && attr==NULL){
+	posix_spawnattr_init(&sa);
+	posix_spawnattr_setflags(&sa, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&sa, pgid);				/* Same as setpgid(0,pgid) in the child */
+	posix_spawnattr_setsigmask(&sa, mask);			/* SIGCHLD, SIGINT and SIGTSTP unblocked in the child */
+	posix_spawn_file_actions_init(&fa);
+	if(err!=STDERR_FILENO)							/* First: 2>&1 may name our stdout */
+		posix_spawn_file_actions_adddup2(&fa, err, STDERR_FILENO);
+	if(in!=STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&fa, in, STDIN_FILENO);
+	if(out!=STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&fa, out, STDOUT_FILENO);
+	traceevent(EV_FORK,'B',0,0);
+	rc=posix_spawn(&pid, path, &fa, &sa, argv, envp);
+	traceevent(EV_FORK,'E',rc?0:pid,pgid);
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&sa);
+	if(rc!=0){
+		printf("%s: Command not found\n",argv[0]);
+		return 0;
 	}
+	return pid;
     }
-    argv[argc] = NULL;
-    
-    if (argc == 0)  /* ignore blank line */
-	return -1;
 
-    /* should the job run in the background? */
-    if ((bg = (*argv[argc-1] == '&')) != 0) {
-	argv[--argc] = NULL;
+    if(attr==NULL || !(attr->flags&A_SCHED) || pipe2(sync,O_CLOEXEC)<0)
+	sync[0]=-1;
+    traceevent(EV_FORK,'B',0,0);
+    if((pid=fork())==0){
+	/* Child */
+	if(tracebuf)
+		tracepid=getpid();
+	if(sync[0]>=0)
+		close(sync[0]);
+	setpgid(0,pgid);		/* Making a Process Group with Child's Process ID (or joining the pipeline's group) */
+	if(err!=STDERR_FILENO)		/* First: 2>&1 may name our stdout */
+		dup2(err,STDERR_FILENO);
+	if(in!=STDIN_FILENO)
+		dup2(in,STDIN_FILENO);
+	if(out!=STDOUT_FILENO)
+		dup2(out,STDOUT_FILENO);
+	if(attr!=NULL)
+		applyattr(attr);
+	sigprocmask(SIG_SETMASK, mask, 0);				/* Unblocking the sigset in child */
+	traceevent(EV_EXEC,'i',pgid?pgid:tracepid,0);
+	execve(path,argv,envp);
+	printf("%s: Command not found\n",argv[0]);
+	fflush(stdout);
+	exit(0);
     }
-    return bg;
+    if(pid<0)
+	unix_error("fork error");
+    traceevent(EV_FORK,'E',pid,pgid);
+    setpgid(pid,pgid?pgid:pid);
+    traceevent(EV_SETPGID,'i',pid,pgid?pgid:pid);
+    if(sync[0]>=0)
+	waitexec(sync);
+    return pid;
 }
 
-/* 
- * builtin_cmd - If the user has typed a built-in command then execute
- *    it immediately.  
+/*
+ * waitexec - Wait until the child holding the write end of the
+ *    close-on-exec pipe sync has exec'd (or exited). A child that
+ *    sets its own priority must be done with it before the shell goes
+ *    on, or a bg, fg or renice typed right after could be undone.
  */
-int builtin_cmd(char **argv) 
+static void waitexec(int *sync)
+{
+    char c;
+
+    close(sync[1]);
+    while(read(sync[0],&c,1)<0 && errno==EINTR)
+	;
+    close(sync[0]);
+}
+
+/*
+ * The launcher (-z) is a process forked at startup, before the shell
+ * has grown, that forks and execs jobs for it. Every fork() copies
+ * the page tables of the process that calls it, so a shell with a
+ * big job table, history or caches pays for its size on each job;
+ * the launcher does not. A request goes over a SOCK_SEQPACKET socket
+ * pair as one message: a launchreq_t, then the path and the args as
+ * NUL-terminated strings, with the child's stdin, stdout, stderr and
+ * working directory passed as fds (SCM_RIGHTS). The reply is the
+ * child's PID, or -errno.
+ *
+ * The launcher keeps the environment it was last sent and gives it to
+ * every child, so the shell only sends one when the child's differs:
+ * after an exported variable changed, or for a command with NAME=value
+ * words. It goes in a memfd, passed as the last fd, so its size is
+ * not bounded by LAUNCHMAX.
+ *
+ * The launcher creates the child with CLONE_PARENT, so its parent is
+ * the shell and not the launcher: the shell gets its SIGCHLD, reaps
+ * it and keeps job control exactly as if it had forked it itself.
+ */
+struct launchreq_t {        /* A request to the launcher; the strings follow */
+    pid_t pgid;             /* process group to join, or 0 for a new one */
+    int argc;               /* number of args */
+    int envc;               /* number of environment strings, or -1 to
+                               keep the last environment */
+    sigset_t mask;          /* signal mask of the child */
+    struct attr_t attr;     /* its placement and limits (if flags) */
+};
+
+struct clone_args_v0 {      /* struct clone_args of Linux 5.3 */
+    uint64_t flags, pidfd, child_tid, parent_tid, exit_signal;
+    uint64_t stack, stack_size, tls;
+};
+
+/* cloneparent - fork() a sibling instead of a child (see above) */
+static pid_t cloneparent(void)
+{
+    struct clone_args_v0 args = { .flags = CLONE_PARENT };
+    long pid;
+
+    /* exit_signal must be 0 with CLONE_PARENT: the child gets ours */
+    if ((pid = syscall(SYS_clone3, &args, sizeof(args))) < 0 && errno == ENOSYS)
+	pid = syscall(SYS_clone, CLONE_PARENT, 0, 0, 0, 0);
+    return pid;
+}
+
+/*
+ * readenv - In the launcher, read the envc strings of the environment
+ *    in the memfd fd into *bufp and point envp at them. Return envp, or
+ *    NULL if it cannot be read.
+ */
+static char **readenv(int fd, int envc, char **bufp, char ***envp)
 {
+    struct stat st;
+    ssize_t n;
+    off_t off;
+    char *p;
     int i;
-    if(strcmp(argv[0],"quit")==0){
-	/* checking for Stopped Process before exiting If there are ST Process Printing ERROR Condition and returning 1 */
-	for(i = 0; i < MAXJOBS; i++){	
-		if(jobs[i].state==ST){
-			printf("There are Stopped Jobs\n");					/* Printing ERROR if there are Stopped Process's */
-			return 1;		
-		}	
+
+    if (fstat(fd, &st) < 0 || (*bufp = realloc(*bufp, st.st_size + 1)) == NULL ||
+	(*envp = realloc(*envp, (envc + 1) * sizeof(char *))) == NULL)
+	return NULL;
+    for (off = 0; off < st.st_size; off += n)
+	if ((n = pread(fd, *bufp + off, st.st_size - off, off)) <= 0)
+	    return NULL;
+    (*bufp)[st.st_size] = '\0';
+    for (i = 0, p = *bufp; i < envc && p < *bufp + st.st_size; i++, p += strlen(p) + 1)
+	(*envp)[i] = p;
+    (*envp)[i] = NULL;
+    return *envp;
+}
+
+/* launcher - The launcher's loop: serve requests until the shell exits */
+static void launcher(int sock)
+{
+    static char buf[LAUNCHMAX];
+    union {                 /* aligned room for the fds */
+	struct cmsghdr hdr;
+	char space[CMSG_SPACE(5 * sizeof(int))];
+    } cbuf;
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    struct launchreq_t *req = (struct launchreq_t *)buf;
+    struct cmsghdr *cm;
+    char **vec = NULL, **env = environ, **envvec = NULL, *envbuf = NULL, *p;
+    int fds[5], nfds, veccap = 0, i, sync[2];
+    ssize_t n;
+    pid_t pid;
+
+    while (1) {
+	msg.msg_control = cbuf.space;
+	msg.msg_controllen = sizeof(cbuf.space);
+	if ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0) {
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    _exit(0);				/* the shell has gone */
 	}
-    	exit(0);										/* If no ST process then exiting with 0 */
-    }else if(strcmp(argv[0],"jobs")==0){
-    	listjobs(jobs);										/* Listing all the Jobs */
-	return 1;
-    }else if(strcmp(argv[0],"fg")==0 ){							      /* if first argument is fg or bg calling do_bgfg function and returning 1 */
-    	do_bgfg(argv);
-	return 1;
-    }else if(strcmp(argv[0],"bg")==0){
-    	do_bgfg(argv);
-	return 1;
-    }else{
-    	return 0;     										/* not a builtin command */
+	nfds = 0;
+	if ((cm = CMSG_FIRSTHDR(&msg)) != NULL && cm->cmsg_type == SCM_RIGHTS) {
+	    nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	    memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+	}
+	if (req->envc >= 0 && nfds > 0) {		/* a new environment */
+	    if ((env = readenv(fds[--nfds], req->envc, &envbuf, &envvec)) == NULL)
+		_exit(1);
+	    close(fds[nfds]);
+	}
+	if (veccap < req->argc + 1) {
+	    veccap = req->argc + 1;
+	    if ((vec = realloc(vec, veccap * sizeof(char *))) == NULL)
+		_exit(1);
+	}
+	p = (char *)(req + 1);
+	for (i = -1; i < req->argc; i++) {		/* the path, args */
+	    if (i >= 0)
+		vec[i] = p;
+	    p += strlen(p) + 1;
+	}
+	vec[req->argc] = NULL;
+
+	if (!(req->attr.flags & A_SCHED) || pipe2(sync, O_CLOEXEC) < 0)
+	    sync[0] = -1;
+	if ((pid = cloneparent()) == 0) {
+	    /* Child: the same steps as a forked child in launch */
+	    if (sync[0] >= 0)
+		close(sync[0]);
+	    setpgid(0, req->pgid);
+	    if (nfds >= 3) {
+		dup2(fds[2], STDERR_FILENO);
+		dup2(fds[0], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+	    }
+	    if (nfds >= 4)
+		fchdir(fds[3]);
+	    if (req->attr.flags)
+		applyattr(&req->attr);
+	    sigprocmask(SIG_SETMASK, &req->mask, 0);
+	    execve((char *)(req + 1), vec, env);
+	    printf("%s: Command not found\n", vec[0]);
+	    fflush(stdout);
+	    _exit(0);
+	}
+	if (pid < 0)
+	    pid = -errno;
+	if (sync[0] >= 0)
+	    waitexec(sync);
+	for (i = 0; i < nfds; i++)
+	    close(fds[i]);
+	if (send(sock, &pid, sizeof(pid), MSG_NOSIGNAL) < 0)
+	    _exit(0);
     }
-    return 0;
 }
 
-/* 
- * do_bgfg - Execute the builtin bg and fg commands
+/*
+ * startlauncher - Fork the launcher and keep our end of its socket in
+ *    launchfd. It leaves the shell's process group, so that the
+ *    signals typed at the terminal do not reach it; it exits when it
+ *    reads end of file, once the shell has exited.
  */
-void do_bgfg(char **argv) 
+static unsigned launchenv;  /* vars.envgen of the environment the launcher
+                               holds, or 0 if it holds another */
+
+void startlauncher(void)
 {
-    struct job_t *p;
-    int a,cd=0,pid=0,flag=1;
+    int sv[2];
 
-    if(argv[1]==NULL){										/* Checking if the first argument is empty or not */
-    	printf("%s command requires PID or %%jobid argument\n",argv[0]);
-	fflush(stdout);
-	return ;
+    launchfd = -1;
+    launchenv = 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+	printf("launcher: socketpair: %s\n", strerror(errno));
+	return;
     }
-    
+    if ((launchpid = fork()) < 0)
+	unix_error("fork error");
+    if (launchpid == 0) {
+	close(sv[0]);
+	setpgid(0, 0);
+	launcher(sv[1]);
+    }
+    close(sv[1]);
+    launchfd = sv[0];
+}
 
-    if((strcmp(argv[0],"fg")==0 || strcmp(argv[0],"bg")==0) && strcmp(argv[1],"\0")==0){	/* Cheking if the Second argument is empty or not */
-    	printf("%s command requires PID or %%jobid argument\n",argv[0]);
-	fflush(stdout);
-    }else{
-	flag=1;
-	for(a=0;a<strlen(argv[1]);a++){				/* Building the pid or jid using character in the argument and checking for any violations */
-		pid=pid*10;
-		if(a==0){									/* For the First Character */
-			if((argv[1][a]=='%') || (argv[1][a]<='9' && argv[1][a]>='0')){
-				if(argv[1][a]!='%'){
-					pid=pid+(int)(argv[1][a]-48);
-				}else{
-					cd=1;							/* cd Used to Distinguish between jid (cd=1) and pid (cd=0) */ 
-				}
-			}else{									/* If the String contains any character other than a number than flag=1 */
-				flag=0;
-				break;
-			}	
-		}else{
-			if((argv[1][a]<='9' && argv[1][a]>='0')){
-	                 	pid=pid+(int)(argv[1][a]-48);
-	        	}else{
-				flag=0;
-				break;
-	        	}
-		}	
+/* stoplauncher - Stop using the launcher, and reap it if it has exited */
+void stoplauncher(void)
+{
+    if (launchfd < 0)
+	return;
+    close(launchfd);
+    launchfd = -1;
+    waitpid(launchpid, NULL, WNOHANG);
+}
+
+/*
+ * envmemfd - A memfd holding the strings of envp, one after the other,
+ *    and their number in *envc; -1 if it cannot be made.
+ */
+static int envmemfd(char **envp, int *envc)
+{
+    static char *buf;
+    static size_t cap;
+    size_t len = 0, n;
+    int fd, i;
+
+    for (i = 0; envp[i] != NULL; i++) {
+	n = strlen(envp[i]) + 1;
+	if (len + n > cap) {
+	    cap = len + n > 2 * cap ? len + n : 2 * cap;
+	    if ((buf = realloc(buf, cap)) == NULL)
+		unix_error("launchvia error");
 	}
-			
-	if(!flag){
-		if(argv[1][0]!='%' || (argv[1][0]<='1'&& argv[1][0]>='9')){
-	/* if the First character of argument is other than % or a number than printing the Appropriate Message */
-			printf("%s: argument must be pid or %%jobid\n",argv[0]);
-			fflush(stdout);
-		}
-		else{
-			printf("%s: No such job\n",argv[1]);			/* checking for any violations in the second argument */
-			fflush(stdout);
-		}	
-	}else{
-		if(cd==1){
-		/* If the User Inputed a JID as Second Argument */
-			p=getjobjid(jobs,pid);							/* Getting the job for jid provided from user using jobs table */
-			if(p==NULL){								/* if there is no job with jid provided printing the error */
-				printf("%s: No such job\n",argv[1]);
-				fflush(stdout);
-			}else{	
-		/* if jid is correct changing the state accordingly and if the state is changed to FG then Waiting for the Process to be completed */
-	/* If the State is ST i.e. Stopped then sending the SIGCONT Signal to the Whole Process Group (done by -(p->pid)) and changing the State as per the user input */
-				if(p->state==ST){
-					if(strcmp(argv[0],"bg")==0){
-						p->state=BG;
-						kill(-(p->pid),SIGCONT);
-						printf("[%d] (%d) %s",pid,p->pid,p->cmdline);
-						fflush(stdout);	
-					}else{
-						p->state=FG;
-						kill(-(p->pid),SIGCONT);
-						waitfg(p->pid);
-					}	
-				}else if(p->state==BG){
-					if(strcmp(argv[0],"fg")==0){
-						p->state=FG;
-						waitfg(p->pid);
-                                        }	
-				}
-							
-			}
-		}else{
-		/* If the User Inputed a PID as Second Argument */	
-			p=getjobpid(jobs,pid);							/* Getting the job for pid provided from user from jobs table */
-			if(p==NULL){								/* if there is no job with pid provided printing the error */
-				printf("(%s): No such process\n",argv[1]);
-				fflush(stdout);
-			}else{								
-		/* if pid is correct changing the state accordingly and if the state is changed to FG then Waiting for the Process to be completed */
-	/* If the State is ST i.e. Stopped then sending the SIGCONT Signal to the Whole Process Group (done by -(p->pid)) and changing the State as per the user input */
-				if(p->state==ST){
-					if(strcmp(argv[0],"bg")==0){
-						p->state=BG;
-						kill(-(p->pid),SIGCONT);
-						printf("[%d] (%d) %s",pid,p->pid,p->cmdline);
-						fflush(stdout);
-					}else if(strcmp(argv[0],"fg")==0){
-						p->state=FG;
-						kill(-(p->pid),SIGCONT);
-						waitfg(p->pid);
-					}	
-				}else if(p->state==BG){
-					if(strcmp(argv[0],"fg")==0){
-						p->state=FG;
-						waitfg(p->pid);
-                                        }	
-				}
-			}
+	memcpy(buf + len, envp[i], n);
+	len += n;
+    }
+    *envc = i;
+    if ((fd = memfd_create("tsh-env", MFD_CLOEXEC)) < 0)
+	return -1;
+    if (write(fd, buf, len) != (ssize_t)len) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+/*
+ * launchvia - Ask the launcher to start a process, with the arguments
+ *    of launch. Return its PID, or -1 if the launcher cannot be used:
+ *    the request does not fit in a message, the launcher could not
+ *    create the process, or it has gone (then it is not asked again).
+ *    The environment is only sent if the launcher does not hold envp.
+ */
+pid_t launchvia(char *path, char **argv, char **envp, sigset_t *mask, pid_t pgid, int in, int out, int err, struct attr_t *attr)
+{
+    static char *buf;
+    union {
+	struct cmsghdr hdr;
+	char space[CMSG_SPACE(5 * sizeof(int))];
+    } cbuf;
+    struct launchreq_t *req;
+    struct iovec iov;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    struct cmsghdr *cm;
+    size_t len = sizeof(struct launchreq_t) + strlen(path) + 1;
+    int fds[5], nfds = 3, cwdfd, envfd = -1, i, envc = -1;
+    char *p;
+    pid_t pid;
+
+    for (i = 0; argv[i] != NULL; i++)
+	len += strlen(argv[i]) + 1;
+    if (len > LAUNCHMAX)
+	return -1;
+    if (buf == NULL && (buf = malloc(LAUNCHMAX)) == NULL)
+	unix_error("launchvia error");
+    if (!(envp == vars.envp && launchenv == vars.envgen) && (envfd = envmemfd(envp, &envc)) < 0)
+	return -1;
+    req = (struct launchreq_t *)buf;
+    req->pgid = pgid;
+    req->argc = i;
+    req->envc = envc;
+    req->mask = *mask;
+    req->attr.flags = 0;
+    if (attr != NULL)
+	req->attr = *attr;
+    p = stpcpy((char *)(req + 1), path) + 1;
+    for (i = 0; argv[i] != NULL; i++)
+	p = stpcpy(p, argv[i]) + 1;
+
+    fds[0] = in;
+    fds[1] = out;
+    fds[2] = err;
+    if ((cwdfd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) >= 0)
+	fds[nfds++] = cwdfd;			/* cd has moved us since it forked */
+    if (envfd >= 0)
+	fds[nfds++] = envfd;			/* always the last one */
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_control = cbuf.space;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+
+    traceevent(EV_FORK,'B',0,0);
+    while ((i = sendmsg(launchfd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+	;
+    if (cwdfd >= 0)
+	close(cwdfd);
+    if (envfd >= 0) {
+	close(envfd);
+	if (i >= 0)
+	    launchenv = envp == vars.envp ? vars.envgen : 0;
+    }
+    if (i < 0 || recv(launchfd, &pid, sizeof(pid), 0) != sizeof(pid)) {
+	traceevent(EV_FORK,'E',0,pgid);
+	printf("launcher: %s, forking jobs from now on\n", i < 0 ? strerror(errno) : "exited");
+	stoplauncher();
+	return -1;
+    }
+    traceevent(EV_FORK,'E',pid>0?pid:0,pgid);
+    if (pid < 0)
+	return -1;
+    setpgid(pid,pgid?pgid:pid);			/* As after fork: ours now */
+    traceevent(EV_SETPGID,'i',pid,pgid?pgid:pid);
+    return pid;
+}
+
+/*
+ * Placement and limits (the pin and limit builtins). An attr_t says
+ * which CPUs a job may run on and which resource limits it gets. It
+ * is applied in each child between fork and exec, so the shell keeps
+ * its own. pin -s spreads background jobs, one CPU per job, over the
+ * CPUs in the order of cpuorder: each job gets a core of its own
+ * before two share one (SMT siblings last), and a NUMA node's cores
+ * are used before the next node's.
+ */
+static const struct limit_t {
+    char opt;               /* option letter of limit */
+    int res;                /* RLIMIT_ resource */
+    char *name;             /* name shown by limit and jobs -l */
+} limits[NLIMITS] = {
+    { 'v', RLIMIT_AS, "as" },
+    { 't', RLIMIT_CPU, "cputime" },
+    { 'n', RLIMIT_NOFILE, "nofile" },
+};
+
+static int ncpuorder;                   /* CPUs the shell may run on */
+static int cpuorder[CPU_SETSIZE];       /* ... in the order jobs are spread */
+
+/* parsecpus - Read a CPU list like 0-3,6 into set: 0, or -1 if malformed */
+static int parsecpus(char *s, cpu_set_t *set)
+{
+    long lo, hi;
+    char *end;
+
+    CPU_ZERO(set);
+    while (1) {
+	lo = hi = strtol(s, &end, 10);
+	if (end == s || lo < 0)
+	    return -1;
+	if (*end == '-') {
+	    s = end + 1;
+	    hi = strtol(s, &end, 10);
+	    if (end == s || hi < lo)
+		return -1;
+	}
+	if (hi >= CPU_SETSIZE)
+	    return -1;
+	for (; lo <= hi; lo++)
+	    CPU_SET(lo, set);
+	if (*end != ',')
+	    break;
+	s = end + 1;
+    }
+    return *end == '\0' || *end == '\n' ? 0 : -1;
+}
+
+/* readcpus - Read a CPU list from a sysfs file: 0, or -1 */
+static int readcpus(char *path, cpu_set_t *set)
+{
+    char buf[4096];
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+	return -1;
+    buf[n] = '\0';
+    return parsecpus(buf, set);
+}
+
+/* printcpus - Print a CPU set as a list like 0-3,6 */
+static void printcpus(cpu_set_t *set)
+{
+    int cpu, end;
+    char *sep = "";
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu = end) {
+	if (!CPU_ISSET(cpu, set)) {
+	    end = cpu + 1;
+	    continue;
+	}
+	for (end = cpu + 1; end < CPU_SETSIZE && CPU_ISSET(end, set); end++)
+	    ;
+	if (end - cpu > 1)
+	    printf("%s%d-%d", sep, cpu, end - 1);
+	else
+	    printf("%s%d", sep, cpu);
+	sep = ",";
+    }
+}
+
+/*
+ * initcpuorder - Find the CPUs the shell may run on, and sort them by
+ *    thread within their core, then by node, then by number.
+ */
+static void initcpuorder(void)
+{
+    static int key[CPU_SETSIZE];
+    cpu_set_t allowed, set;
+    char path[80];
+    int cpu, node, i, j, rank;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+	CPU_ZERO(&allowed);
+	CPU_SET(0, &allowed);
+    }
+    for (node = 0; node < 64; node++) {		/* CPUs of a node share its memory */
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	if (readcpus(path, &set) == 0)
+	    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &set))
+		    key[cpu] = node * CPU_SETSIZE;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+	if (!CPU_ISSET(cpu, &allowed))
+	    continue;
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+	rank = 0;
+	if (readcpus(path, &set) == 0)		/* SMT siblings numbered below us */
+	    for (j = 0; j < cpu; j++)
+		rank += CPU_ISSET(j, &set) != 0;
+	key[cpu] += rank * 64 * CPU_SETSIZE + cpu;
+	for (i = ncpuorder++; i > 0 && key[cpuorder[i-1]] > key[cpu]; i--)
+	    cpuorder[i] = cpuorder[i-1];	/* insertion sort: few CPUs */
+	cpuorder[i] = cpu;
+    }
+}
+
+/*
+ * spreadcpu - Choose the CPU of a background job that a's pin -s
+ *    spreads: the first one in cpuorder (among a's CPUs, if any) that
+ *    the fewest running jobs were spread to. Return -1 if there is
+ *    none.
+ */
+int spreadcpu(struct attr_t *a)
+{
+    static int load[CPU_SETSIZE];
+    struct job_t *job;
+    int i, cpu, best = -1;
+
+    if (ncpuorder == 0)
+	initcpuorder();
+    memset(load, 0, sizeof(load));
+    for (i = 1; i <= jobs.maxjid; i++)
+	if ((job = jobs.byjid[i]) != NULL && job->state != QU && job->attr.cpu >= 0)
+	    load[job->attr.cpu]++;
+    for (i = 0; i < ncpuorder; i++) {
+	cpu = cpuorder[i];
+	if ((a->flags & A_CPUS) && !CPU_ISSET(cpu, &a->cpus))
+	    continue;
+	if (best < 0 || load[cpu] < load[best])
+	    best = cpu;
+    }
+    return best;
+}
+
+/* parselimit - Read the value of limit i: 0, or -1 (after saying why) */
+static int parselimit(int i, char *s, rlim_t *v)
+{
+    struct rlimit rl;
+    unsigned long long n;
+    char *end;
+
+    if (strcmp(s, "unlimited") == 0)
+	n = RLIM_INFINITY;
+    else {
+	n = strtoull(s, &end, 10);
+	if (end == s || (*end != '\0' && (limits[i].res != RLIMIT_AS || end[1] != '\0'))) {
+	    printf("limit: -%c: bad value %s\n", limits[i].opt, s);
+	    return -1;
+	}
+	switch (*end) {			/* sizes can be given in K, M or G */
+	case 'G': case 'g': n <<= 10; /* fall through */
+	case 'M': case 'm': n <<= 10; /* fall through */
+	case 'K': case 'k': n <<= 10; /* fall through */
+	case '\0': break;
+	default:
+	    printf("limit: -%c: bad value %s\n", limits[i].opt, s);
+	    return -1;
+	}
+    }
+    if (getrlimit(limits[i].res, &rl) == 0 && rl.rlim_max != RLIM_INFINITY && n > rl.rlim_max) {
+	printf("limit: -%c: %s is above the hard limit\n", limits[i].opt, s);
+	return -1;
+    }
+    *v = n;
+    return 0;
+}
+
+/*
+ * parseattr - Apply the pin and limit commands at the start of argv
+ *    (pin [cpus] [-s] [off], limit [-v|-t|-n value|off]...) to *a.
+ *    Return the number of words they take, or -1 (after saying why)
+ *    if one of them is malformed. The words after are the command.
+ */
+int parseattr(char **argv, struct attr_t *a)
+{
+    cpu_set_t set;
+    char **w = argv;
+    int i;
+
+    while (*w != NULL) {
+	if (strcmp(*w, "pin") == 0) {
+	    for (w++; *w != NULL; w++) {
+		if (strcmp(*w, "-s") == 0)
+		    a->flags |= A_SPREAD;
+		else if (strcmp(*w, "off") == 0)
+		    a->flags &= ~(A_CPUS | A_SPREAD);
+		else if (isdigit((unsigned char)**w)) {
+		    if (ncpuorder == 0)
+			initcpuorder();
+		    if (parsecpus(*w, &a->cpus) < 0) {
+			printf("pin: %s: bad CPU list\n", *w);
+			return -1;
+		    }
+		    CPU_ZERO(&set);
+		    for (i = 0; i < ncpuorder; i++)
+			CPU_SET(cpuorder[i], &set);
+		    CPU_AND(&set, &set, &a->cpus);
+		    if (CPU_COUNT(&set) == 0) {
+			printf("pin: %s: none of these CPUs is available\n", *w);
+			return -1;
+		    }
+		    a->flags |= A_CPUS;
+		}
+		else
+		    break;
+	    }
+	}
+	else if (strcmp(*w, "limit") == 0) {
+	    for (w++; *w != NULL && (*w)[0] == '-' && (*w)[1] != '\0' && (*w)[2] == '\0'; w += 2) {
+		for (i = 0; i < NLIMITS && limits[i].opt != (*w)[1]; i++)
+		    ;
+		if (i == NLIMITS || w[1] == NULL) {
+		    printf("limit: %s: %s\n", *w, i == NLIMITS ? "unknown limit" : "needs a value");
+		    return -1;
 		}
+		if (strcmp(w[1], "off") == 0)
+		    a->flags &= ~(A_LIMIT << i);
+		else if (parselimit(i, w[1], &a->lim[i]) < 0)
+		    return -1;
+		else
+		    a->flags |= A_LIMIT << i;
+	    }
+	}
+	else
+	    break;
+    }
+    return w - argv;
+}
+
+/*
+ * prefixlen - The number of words of the pin or limit prefix of the
+ *    command in argv (0 if there is none, or if pin or limit is the
+ *    command itself), or -1 if it is malformed.
+ */
+static int prefixlen(char **argv)
+{
+    struct attr_t a = defattr;
+    int n;
+
+    if (argv[0][0] != 'p' && argv[0][0] != 'l')
+	return 0;
+    if ((n = parseattr(argv, &a)) < 0)
+	return -1;
+    return argv[n] != NULL ? n : 0;
+}
+
+/* applyattr - In a child, before exec: place and limit it as a says */
+void applyattr(struct attr_t *a)
+{
+    struct sched_param sp = { 0 };
+    struct rlimit rl;
+    cpu_set_t set;
+    int i;
+
+    if (a->cpu >= 0) {
+	CPU_ZERO(&set);
+	CPU_SET(a->cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+    }
+    else if (a->flags & A_CPUS)
+	sched_setaffinity(0, sizeof(a->cpus), &a->cpus);
+    if (a->flags & A_SCHED) {
+	setpriority(PRIO_PROCESS, 0, a->nice);
+	if (a->policy != SCHED_OTHER)
+	    sched_setscheduler(0, a->policy, &sp);
+    }
+    for (i = 0; i < NLIMITS; i++) {
+	if (!(a->flags & (A_LIMIT << i)) || getrlimit(limits[i].res, &rl) < 0)
+	    continue;
+	rl.rlim_cur = a->lim[i];
+	setrlimit(limits[i].res, &rl);
+    }
+}
+
+/* policyname - How a scheduling policy is shown: "" for SCHED_OTHER */
+static char *policyname(int policy)
+{
+    return policy == SCHED_BATCH ? "  batch" : policy == SCHED_IDLE ? "  idle" : "";
+}
+
+/* printlimit - Print the value v of limit i */
+static void printlimit(int i, unsigned long long v)
+{
+    int u;
+
+    if (v == RLIM_INFINITY)
+	printf("unlimited");
+    else if (limits[i].res == RLIMIT_AS) {
+	for (u = 0; v >= 1024 && v % 1024 == 0 && u < 3; u++)
+	    v >>= 10;
+	printf("%llu%.*s", v, u > 0, &"KMG"[u > 0 ? u - 1 : 0]);
+    }
+    else
+	printf("%llu", v);
+}
+
+/* printattr - Print the placement and limits in a, each after two spaces */
+void printattr(struct attr_t *a)
+{
+    int i;
+
+    if (a->cpu >= 0)
+	printf("  cpu %d", a->cpu);
+    else if (a->flags & A_CPUS) {
+	printf("  cpus ");
+	printcpus(&a->cpus);
+    }
+    if ((a->flags & A_SPREAD) && a->cpu < 0)
+	printf("  spread");
+    if (a->flags & A_SCHED)
+	printf("  nice %d%s", a->nice, policyname(a->policy));
+    for (i = 0; i < NLIMITS; i++) {
+	if (!(a->flags & (A_LIMIT << i)))
+	    continue;
+	printf("  %s ", limits[i].name);
+	printlimit(i, a->lim[i]);
+    }
+}
+
+/*
+ * Background scheduling (the bgsched and renice builtins). With a
+ * bgsched policy, a job runs nicer, or with SCHED_BATCH or SCHED_IDLE,
+ * for as long as it is in the background, so that a runaway & job
+ * does not slow down the command we are waiting on. A job launched in
+ * the background gets it in the child before exec, so whatever it
+ * forks inherits it. When bg or fg moves a job, schedjob changes the
+ * nice value of its whole process group with setpriority(PRIO_PGRP),
+ * and the policy of every thread in the group. Making a job nicer is
+ * always allowed. Giving its priority back (fg) needs CAP_SYS_NICE or
+ * a high enough RLIMIT_NICE; without them the job stays where it is.
+ */
+
+/*
+ * wantsched - Set the nice value and policy in a for a job in state
+ *    state whose own nice value is nice.
+ */
+void wantsched(struct attr_t *a, int state, int nice)
+{
+    a->nice = nice;
+    a->policy = SCHED_OTHER;
+    if (state == BG && bgpolicy >= 0) {
+	a->nice = nice + bgnice > 19 ? 19 : nice + bgnice;
+	a->policy = bgpolicy;
+    }
+    if (a->nice != 0 || a->policy != SCHED_OTHER)
+	a->flags |= A_SCHED;
+    else
+	a->flags &= ~A_SCHED;
+}
+
+/*
+ * setprocsched - Set the scheduling policy of every thread of process
+ *    pid, and set *forked if a thread has children (or we cannot
+ *    tell). Return 0, or -1 with errno set if one could not be changed.
+ */
+static int setprocsched(pid_t pid, int policy, int *forked)
+{
+    struct sched_param sp = { 0 };
+    struct dirent *te;
+    DIR *task;
+    char path[64], c;
+    int fd, tid, rc = 0, err = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    if ((task = opendir(path)) == NULL)
+	return 0;			/* it is gone, or about to be reaped */
+    while ((te = readdir(task)) != NULL) {
+	if (!isdigit((unsigned char)te->d_name[0]))
+	    continue;
+	tid = atoi(te->d_name);
+	if (sched_setscheduler(tid, policy, &sp) < 0 && errno != ESRCH) {
+	    rc = -1;
+	    err = errno;
+	}
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, tid);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || read(fd, &c, 1) != 0)
+	    *forked = 1;
+	if (fd >= 0)
+	    close(fd);
+    }
+    closedir(task);
+    errno = err;
+    return rc;
+}
+
+/*
+ * scangroupsched - Set the scheduling policy of every thread of every
+ *    process in group pgid, found in /proc. Return 0, or -1 with
+ *    errno set if one of them could not be changed.
+ */
+static int scangroupsched(pid_t pgid, int policy)
+{
+    struct sched_param sp = { 0 };
+    struct dirent *de, *te;
+    DIR *proc, *task;
+    char path[64], buf[512], *p;
+    int fd, pg, rc = 0, err = 0;
+    pid_t pid;
+    ssize_t n;
+
+    if ((proc = opendir("/proc")) == NULL)
+	return -1;
+    while ((de = readdir(proc)) != NULL) {
+	if (!isdigit((unsigned char)de->d_name[0]))
+	    continue;
+	pid = atoi(de->d_name);
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	    continue;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+	    continue;
+	buf[n] = '\0';
+	/* pid (comm) state ppid pgrp ...: comm may hold anything */
+	if ((p = strrchr(buf, ')')) == NULL || sscanf(p + 1, " %*c %*d %d", &pg) != 1 || pg != pgid)
+	    continue;
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	if ((task = opendir(path)) == NULL)
+	    continue;
+	while ((te = readdir(task)) != NULL)
+	    if (isdigit((unsigned char)te->d_name[0]) &&
+		sched_setscheduler(atoi(te->d_name), policy, &sp) < 0 && errno != ESRCH) {
+		rc = -1;
+		err = errno;
+	    }
+	closedir(task);
+    }
+    closedir(proc);
+    errno = err;
+    return rc;
+}
+
+/*
+ * setgroupsched - Set the scheduling policy of every thread of every
+ *    process in job's group. Return 0, or -1 with errno set if one of
+ *    them could not be changed.
+ *
+ * The processes we started are in job->procs. Only if one of them has
+ * forked, or has exited and may have left children behind, can the
+ * group hold processes we do not know; only then is /proc scanned.
+ */
+static int setgroupsched(struct job_t *job, int policy)
+{
+    int i, forked = 0, rc = 0, err = 0;
+
+    for (i = 0; i < job->nprocs; i++) {
+	if (job->procs[i].done)
+	    forked = 1;
+	else if (setprocsched(job->procs[i].pid, policy, &forked) < 0) {
+	    rc = -1;
+	    err = errno;
+	}
+    }
+    if (forked)
+	return scangroupsched(job->pid, policy);
+    errno = err;
+    return rc;
+}
+
+/*
+ * schedjob - Give the processes of a job the nice value and policy it
+ *    should have in its state. Return 0, or -1 (after saying why) if
+ *    they could not be changed.
+ */
+int schedjob(struct job_t *job)
+{
+    struct attr_t want = job->attr;
+
+    if (job->state == QU || job->state == ST)
+	return 0;			/* it gets them when it starts or goes on */
+    wantsched(&want, job->state, job->nice);
+    if (want.policy == SCHED_OTHER && want.policy != job->attr.policy) {
+	if (setgroupsched(job, want.policy) < 0)
+	    goto fail;			/* back to normal: the policy first */
+	job->attr.policy = want.policy;
+    }
+    if (want.nice != job->attr.nice) {
+	if (setpriority(PRIO_PGRP, job->pid, want.nice) < 0)
+	    goto fail;
+	job->attr.nice = want.nice;
+    }
+    if (want.policy != job->attr.policy) {
+	if (setgroupsched(job, want.policy) < 0)
+	    goto fail;
+	job->attr.policy = want.policy;
+    }
+    job->attr.flags = want.flags;
+    return 0;
+
+ fail:
+    printf("[%d] (%d): cannot change its priority: %s\n", job->jid, job->pid, strerror(errno));
+    if (job->attr.nice != 0 || job->attr.policy != SCHED_OTHER)
+	job->attr.flags |= A_SCHED;	/* what it was left with */
+    return -1;
+}
+
+/*
+ * openredirs - Open the files of the redirections of command stage, in
+ *    order, and set fds[0], fds[1] and fds[2] to the fd that replaces
+ *    its stdin, stdout and stderr: -1 for none, or -2 for a 2>&1 that
+ *    comes before any > (the command's own stdout). The files are
+ *    opened close-on-exec, so only the child they are dup'ed into
+ *    keeps them. Return 0, or -1 (with nothing left open) if a file
+ *    cannot be opened.
+ */
+int openredirs(struct redir_t *redirs, int nredirs, int stage, int *fds)
+{
+    struct redir_t *r;
+    int fd, old;
+
+    fds[0] = fds[1] = fds[2] = -1;
+    for (r = redirs; r < redirs + nredirs; r++) {
+	if (r->stage != stage)
+	    continue;
+	if (r->file == NULL)			/* 2>&1 */
+	    fd = fds[1] >= 0 ? fds[1] : -2;
+	else if ((fd = open(r->file, r->flags | O_CLOEXEC, 0666)) < 0) {
+	    printf("%s: %s\n", r->file, strerror(errno));
+	    closeredirs(fds);
+	    return -1;
+	}
+	old = fds[r->fd];
+	fds[r->fd] = fd;
+	if (old >= 0 && old != fds[0] && old != fds[1] && old != fds[2])
+	    close(old);				/* > a > b: a is created but not used */
+    }
+    return 0;
+}
+
+/* closeredirs - Close the fds opened by openredirs */
+void closeredirs(int *fds)
+{
+    if (fds[0] >= 0)
+	close(fds[0]);
+    if (fds[1] >= 0)
+	close(fds[1]);
+    if (fds[2] >= 0 && fds[2] != fds[1])
+	close(fds[2]);
+}
+
+/*
+ * runbuiltin - Run the builtin of a plan in the shell. Its redirections
+ *    are applied to the shell's own stdin, stdout and stderr while it
+ *    runs.
+ */
+void runbuiltin(struct plan_t *plan)
+{
+    static const int order[3] = { 2, 0, 1 };	/* 2>&1 first, as in launch */
+    int fds[3], saved[3], i, fd;
+
+    if (plan->nredirs == 0) {
+	builtins[plan->builtin].fn(plan->argvs[0]);
+	return;
+    }
+    if (openredirs(plan->redirs, plan->nredirs, 0, fds) < 0) {
+	exitstatus = 1;
+	return;
+    }
+    fflush(stdout);
+    for (i = 0; i < 3; i++) {
+	fd = order[i];
+	saved[fd] = -1;
+	if (fds[fd] == -1)
+	    continue;
+	if ((saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10)) < 0)
+	    unix_error("runbuiltin error");
+	dup2(fds[fd] == -2 ? STDOUT_FILENO : fds[fd], fd);
+    }
+    builtins[plan->builtin].fn(plan->argvs[0]);
+    fflush(stdout);
+    for (i = 2; i >= 0; i--) {
+	fd = order[i];
+	if (saved[fd] >= 0) {
+	    dup2(saved[fd], fd);
+	    close(saved[fd]);
+	}
+    }
+    closeredirs(fds);
+}
+
+/*
+ * Character classes for parseline
+ */
+#define C_END    1      /* ends an unquoted word: a blank or the NUL */
+#define C_QUOTE  2      /* starts quoting: ' " or \ */
+#define C_ESC    4      /* quoted by a backslash outside quotes */
+#define C_DQESC  8      /* quoted by a backslash inside double quotes */
+
+static const unsigned char cclass[256] = {
+    ['\0'] = C_END,
+    [' '] = C_END | C_ESC, ['\t'] = C_END | C_ESC,
+    ['\n'] = C_END | C_ESC | C_DQESC, ['\r'] = C_END,
+    ['\''] = C_QUOTE | C_ESC, ['"'] = C_QUOTE | C_ESC | C_DQESC,
+    ['\\'] = C_QUOTE | C_ESC | C_DQESC,
+    ['$'] = C_ESC | C_DQESC, ['`'] = C_ESC | C_DQESC,
+    ['|'] = C_ESC, ['&'] = C_ESC, ['<'] = C_ESC, ['>'] = C_ESC, [';'] = C_ESC,
+};
+
+static char pipeop[] = "|";     /* the | operator in argv; a quoted "|" is
+                                   a different string */
+
+/* Redirection operators, longest first, and what they do. In argv an
+ * operator is a pointer into redirops, so a quoted ">" is a word. */
+#define NREDIROPS 6
+static char redirops[NREDIROPS][5] = { "2>&1", "2>>", "2>", ">>", ">", "<" };
+static const int redirfd[NREDIROPS] = { 2, 2, 2, 1, 1, 0 };
+static const int redirflags[NREDIROPS] = {  /* -1: no file */
+    -1, O_WRONLY | O_CREAT | O_APPEND, O_WRONLY | O_CREAT | O_TRUNC,
+    O_WRONLY | O_CREAT | O_APPEND, O_WRONLY | O_CREAT | O_TRUNC, O_RDONLY,
+};
+#define ISREDIROP(p) ((p) >= redirops[0] && (p) < redirops[NREDIROPS])
+
+static unsigned lineexp;        /* what the last line parsed expanded: 0
+                                   nothing, vars.gen variables, ~0u $? */
+
+/* putexp - Append the n bytes at src to the line being expanded */
+static void putexp(unsigned char **bufp, size_t *capp, size_t *lenp, const char *src, size_t n)
+{
+    if (*lenp + n + 1 > *capp) {
+	*capp = *lenp + n + 1 > 2 * *capp ? *lenp + n + 1 : 2 * *capp;
+	if ((*bufp = realloc(*bufp, *capp)) == NULL)
+	    unix_error("parseline error");
+    }
+    memcpy(*bufp + *lenp, src, n);
+    *lenp += n;
+}
+
+/*
+ * expandvars - Copy cmdline into *bufp (of *capp bytes, grown as
+ *    needed) with each $NAME, ${NAME}, $? and $$ outside single
+ *    quotes replaced by its value, quoted so that the tokenizer takes
+ *    it literally: one word, with no operators in it. An unset
+ *    variable is empty, and an empty value outside quotes leaves no
+ *    word. Sets lineexp.
+ */
+static void expandvars(const char *cmdline, unsigned char **bufp, size_t *capp)
+{
+    const char *s = cmdline, *name, *val, *v;
+    char num[16];
+    size_t len = 0, nlen;
+    int dq = 0;
+
+    lineexp = 0;
+    while (*s != '\0') {
+	if (*s == '\'' && !dq) {		/* copied as it is, up to the next ' */
+	    if ((v = strchr(s + 1, '\'')) == NULL)
+		v = s + strlen(s) - 1;
+	    putexp(bufp, capp, &len, s, v - s + 1);
+	    s = v + 1;
+	    continue;
+	}
+	if (*s == '\\' && s[1] != '\0') {	/* \$ stays a $ */
+	    putexp(bufp, capp, &len, s, 2);
+	    s += 2;
+	    continue;
+	}
+	if (*s == '"')
+	    dq = !dq;
+	if (*s != '$' || !(namelen(s + 1) > 0 || s[1] == '{' || s[1] == '?' || s[1] == '$')) {
+	    putexp(bufp, capp, &len, s++, 1);
+	    continue;
+	}
+
+	if (s[1] == '?' || s[1] == '$') {
+	    snprintf(num, sizeof(num), "%d", s[1] == '?' ? exitstatus : (int)getpid());
+	    if (s[1] == '?')
+		lineexp = ~0u;
+	    val = num;
+	    s += 2;
+	}
+	else {
+	    name = s + 1 + (s[1] == '{');
+	    nlen = namelen(name);
+	    if (s[1] == '{' && (nlen == 0 || name[nlen] != '}')) {
+		putexp(bufp, capp, &len, s++, 1);	/* not a ${NAME}: literal */
+		continue;
+	    }
+	    if ((val = getvar(name, nlen)) == NULL)
+		val = "";
+	    if (lineexp != ~0u)
+		lineexp = vars.gen;
+	    s = name + nlen + (s[1] == '{');
+	}
+
+	if (dq) {				/* "...$x...": escape what " would take */
+	    for (v = val; *v != '\0'; v++) {
+		if (*v == '\\' || *v == '"' || *v == '$' || *v == '`')
+		    putexp(bufp, capp, &len, "\\", 1);
+		putexp(bufp, capp, &len, v, 1);
+	    }
+	}
+	else if (*val != '\0') {		/* 'value', with ' as '\'' */
+	    putexp(bufp, capp, &len, "'", 1);
+	    for (v = val; *v != '\0'; v++) {
+		if (*v == '\'')
+		    putexp(bufp, capp, &len, "'\\''", 4);
+		else
+		    putexp(bufp, capp, &len, v, 1);
+	    }
+	    putexp(bufp, capp, &len, "'", 1);
+	}
+    }
+    putexp(bufp, capp, &len, "", 0);
+    (*bufp)[len] = '\0';
+}
+
+/* 
+ * parseline - Parse the command line and build the argv array.
+ * 
+ * The line is copied once into a static buffer and tokenized there in
+ * one pass: the words are NUL-terminated in place and only moved when
+ * quotes are taken out of them. There is no limit on the length of a
+ * line or on the number of words. The buffer and the argv array are
+ * reused, and valid until the next call.
+ *
+ * Words are separated by spaces and tabs, and quoted much as in a
+ * POSIX shell:
+ *
+ *     '...'   everything up to the next ' is literal
+ *     "..."   literal, except that \ quotes a $, `, ", \ or newline
+ *     \c      quotes c if it is a blank, a quote, \ or an operator
+ *             character; before anything else the backslash is kept,
+ *             so that escapes for echo -e (\046) pass through
+ *
+ * Outside single quotes, $NAME, ${NAME}, $? (the last exit status) and
+ * $$ (the shell's PID) are first replaced by their values (see
+ * expandvars). A value is never split into words and never makes an
+ * operator, as if it were quoted.
+ *
+ * Quoted and unquoted parts run together into one word: 'a b'c is
+ * "a bc". An unquoted |, &, <, >, >>, 2>, 2>> or 2>&1 that starts a
+ * word is an operator: | is kept in argv to separate the commands of
+ * a pipeline (see splitpipeline), the redirections are kept in argv
+ * before their file (see splitredirs), and & must end the line. Inside
+ * a word they are ordinary characters, so "tsh>" is one word. Return
+ * true if the user has requested a BG job, false if the user has
+ * requested a FG job, and -1 for a blank line or a syntax error.
+ */
+int parseline(const char *cmdline, char ***argvp) 
+{
+    static unsigned char *line; /* copy of the line, tokenized in place */
+    static size_t linecap;      /* bytes allocated for line */
+    static char **args;         /* the argv array */
+    static int argscap;         /* slots allocated in args */
+    unsigned char *s;           /* next character to read */
+    unsigned char *w;           /* where it goes once unquoted (w <= s) */
+    int argc = 0;               /* number of args */
+    int bg = 0;                 /* background job? */
+    int i;
+    size_t len = strlen(cmdline);
+
+    if (len + 1 > linecap) {
+	linecap = len + 1 > MAXLINE ? len + 1 : MAXLINE;
+	if ((line = realloc(line, linecap)) == NULL)
+	    unix_error("parseline error");
+    }
+    if (memchr(cmdline, '$', len) != NULL)
+	expandvars(cmdline, &line, &linecap);
+    else {
+	memcpy(line, cmdline, len + 1);
+	lineexp = 0;
+    }
+    s = line;
+
+    while (1) {
+	if (argc + 2 > argscap) {	/* room for a word and the NULL */
+	    argscap = argscap ? argscap * 2 : 64;
+	    if ((args = realloc(args, argscap * sizeof(char *))) == NULL)
+		unix_error("parseline error");
+	}
+	while (cclass[*s] & C_END && *s != '\0')	/* skip blanks */
+	    s++;
+	if (*s == '\0')
+	    break;
+	if (bg) {
+	    printf("syntax error near '&'\n");
+	    return -1;
+	}
+	if (*s == '|') {
+	    args[argc++] = pipeop;
+	    s++;
+	    continue;
+	}
+	if (*s == '&') {
+	    bg = 1;
+	    s++;
+	    continue;
+	}
+	if (*s == '<' || *s == '>' || (*s == '2' && s[1] == '>')) {
+	    for (i = 0; strncmp((char *)s, redirops[i], strlen(redirops[i])) != 0; i++)
+		;
+	    args[argc++] = redirops[i];
+	    s += strlen(redirops[i]);
+	    continue;
+	}
+
+	/* Take the quoting out of one word. Until the first quote the
+	 * word is already in place, after that it is moved down. */
+	args[argc++] = (char *)s;
+	w = s;
+	while (!(cclass[*s] & C_END)) {
+	    if (!(cclass[*s] & C_QUOTE)) {
+		if (w == s) {
+		    do			/* a run of plain characters */
+			s++;
+		    while (cclass[*s] == 0);
+		    w = s;
+		}
+		else {
+		    do
+			*w++ = *s++;
+		    while (cclass[*s] == 0);
+		}
+	    }
+	    else if (*s == '\'') {
+		for (s++; *s != '\''; )
+		    if ((*w++ = *s++) == '\0')
+			goto unterminated;
+		s++;
+	    }
+	    else if (*s == '"') {
+		for (s++; *s != '"'; ) {
+		    if (*s == '\\' && cclass[s[1]] & C_DQESC)
+			s++;
+		    if ((*w++ = *s++) == '\0')
+			goto unterminated;
+		}
+		s++;
+	    }
+	    else if (s[1] == '\n')	/* \ newline joins lines */
+		s += 2;
+	    else {
+		if (cclass[s[1]] & C_ESC)
+		    s++;
+		*w++ = *s++;
+	    }
+	}
+	if (*s != '\0')			/* the blank after the word */
+	    s++;
+	*w = '\0';
+    }
+    args[argc] = NULL;
+    *argvp = args;
+    
+    if (argc == 0)  /* ignore blank line */
+	return -1;
+    return bg;
+
+ unterminated:
+    printf("syntax error: unterminated quote\n");
+    return -1;
+}
+
+/*
+ * splitredirs - Take the redirections out of each of the nstages
+ *    commands of a split pipeline (see splitpipeline), closing up the
+ *    words that are left. The redirections are stored in order in
+ *    *redirp, a static array that is valid until the next call. Return
+ *    their number, or -1 (after saying why) if an operator has no file
+ *    or a command is left with no words.
+ */
+int splitredirs(char **argv, int *stage, int nstages, struct redir_t **redirp)
+{
+    static struct redir_t *redirs;
+    static int redircap;
+    struct redir_t *r;
+    int i, j, k, op, n = 0;
+
+    for (i = 0; i < nstages; i++) {
+	for (j = k = stage[i]; argv[j] != NULL; j++) {
+	    if (!ISREDIROP(argv[j])) {
+		argv[k++] = argv[j];
+		continue;
+	    }
+	    op = argv[j] - redirops[0];
+	    op /= sizeof(redirops[0]);
+	    if (redirflags[op] >= 0 && (argv[j+1] == NULL || ISREDIROP(argv[j+1]))) {
+		printf("syntax error near '%s'\n", argv[j]);
+		return -1;
+	    }
+	    if (n == redircap) {
+		redircap = redircap ? redircap * 2 : 8;
+		if ((redirs = realloc(redirs, redircap * sizeof(struct redir_t))) == NULL)
+		    unix_error("splitredirs error");
+	    }
+	    r = &redirs[n++];
+	    r->stage = i;
+	    r->fd = redirfd[op];
+	    r->flags = redirflags[op];
+	    r->file = redirflags[op] >= 0 ? argv[++j] : NULL;
+	}
+	if (k == stage[i]) {
+	    printf("syntax error: redirection without a command\n");
+	    return -1;
+	}
+	argv[k] = NULL;
+    }
+    *redirp = redirs;
+    return n;
+}
+
+/*
+ * splitpipeline - Split argv at each | operator into the commands of
+ *    a pipeline. The operators are replaced by NULL and the index of
+ *    the first word of each command is stored in *stagep, a static
+ *    array that is valid until the next call. Return the number of
+ *    commands, or 0 if one of them is empty.
+ */
+int splitpipeline(char **argv, int **stagep)
+{
+    static int *stage;
+    static int stagecap;
+    int i, n = 0;
+
+    for (i = 0; argv[i] != NULL; i++)
+	if (argv[i] == pipeop)
+	    n++;
+    if (n + 1 > stagecap) {
+	stagecap = n + 1 > 16 ? n + 1 : 16;
+	if ((stage = realloc(stage, stagecap * sizeof(int))) == NULL)
+	    unix_error("splitpipeline error");
+    }
+    *stagep = stage;
+
+    n = 0;
+    stage[n++] = 0;
+    for (i = 0; argv[i] != NULL; i++) {
+	if (argv[i] == pipeop) {
+	    if (i == stage[n-1])
+		return 0;
+	    argv[i] = NULL;
+	    stage[n++] = i + 1;
+	}
+    }
+    if (i == stage[n-1])
+	return 0;
+    return n;
+}
+
+/* 
+ * builtin_cmd - If the user has typed a built-in command then execute
+ *    it immediately.  
+ */
+int builtin_cmd(char **argv) 
+{
+    int i;
+
+    if((i=findbuiltin(argv[0]))<0)
+	return 0;     										/* not a builtin command */
+    builtins[i].fn(argv);
+    return 1;
+}
+
+/*
+ * findbuiltin - Return the index in builtins[] of the builtin called
+ *    name, or -1 if there is none. The names are hashed into an open
+ *    addressed table (built on the first call) that is kept at most a
+ *    third full, so a lookup is one hash and a probe or two.
+ */
+int findbuiltin(char *name)
+{
+    static unsigned char slot[BUILTINHASH];					/* index+1 of the builtin, 0 if free */
+    static int ready;
+    unsigned h;
+    char *s;
+    int i;
+
+    if(!ready){
+	for(i=0;i<NBUILTINS;i++){
+		for(h=2166136261u,s=builtins[i].name;*s;s++)
+			h=(h^(unsigned char)*s)*16777619u;
+		while(slot[h&(BUILTINHASH-1)]!=0)
+			h++;
+		slot[h&(BUILTINHASH-1)]=i+1;
+	}
+	ready=1;
+    }
+    for(h=2166136261u,s=name;*s;s++)
+	h=(h^(unsigned char)*s)*16777619u;
+    for(;(i=slot[h&(BUILTINHASH-1)])!=0;h++)
+	if(strcmp(name,builtins[i-1].name)==0)
+		return i-1;
+    return -1;
+}
+
+/*
+ * do_quit - Execute the builtin quit command
+ */
+void do_quit(char **argv)
+{
+    int i;
+    /* checking for Stopped Process before exiting If there are ST Process Printing ERROR Condition and returning */
+    for(i = 1; i <= maxjid(&jobs); i++){	
+	if(getjobjid(&jobs,i)!=NULL && getjobjid(&jobs,i)->state==ST){
+		printf("There are Stopped Jobs\n");					/* Printing ERROR if there are Stopped Process's */
+		return;		
+	}	
+    }
+    if(admit.nqueued>0){
+	printf("There are Queued Jobs\n");						/* They would be lost */
+	return;
+    }
+    exit(0);											/* If no ST process then exiting with 0 */
+}
+
+/*
+ * do_jobs - Execute the builtin jobs command (jobs -l adds the
+ *    resource usage of each job, and its pin and limit placement)
+ */
+void do_jobs(char **argv)
+{
+    listjobs(&jobs,argv[1]!=NULL && strcmp(argv[1],"-l")==0);
+}
+
+/* 
+ * do_bgfg - Execute the builtin bg and fg commands. The job is given
+ *    the priority of its new state (see bgsched).
+ */
+void do_bgfg(char **argv) 
+{
+    struct job_t *p;
+    int a,cd=0,pid=0,flag=1;
+
+    if(argv[1]==NULL){										/* Checking if the first argument is empty or not */
+    	printf("%s command requires PID or %%jobid argument\n",argv[0]);
+	fflush(stdout);
+	return ;
+    }
+
+    if((strcmp(argv[0],"fg")==0 || strcmp(argv[0],"bg")==0) && strcmp(argv[1],"\0")==0){	/* Cheking if the Second argument is empty or not */
+    	printf("%s command requires PID or %%jobid argument\n",argv[0]);
+	fflush(stdout);
+    }else{
+	flag=1;
+	for(a=0;a<strlen(argv[1]);a++){				/* Building the pid or jid using character in the argument and checking for any violations */
+		pid=pid*10;
+		if(a==0){									/* For the First Character */
+			if((argv[1][a]=='%') || (argv[1][a]<='9' && argv[1][a]>='0')){
+				if(argv[1][a]!='%'){
+					pid=pid+(int)(argv[1][a]-48);
+				}else{
+					cd=1;							/* cd Used to Distinguish between jid (cd=1) and pid (cd=0) */ 
+				}
+			}else{									/* If the String contains any character other than a number than flag=1 */
+				flag=0;
+				break;
+			}	
+		}else{
+			if((argv[1][a]<='9' && argv[1][a]>='0')){
+	                 	pid=pid+(int)(argv[1][a]-48);
+	        	}else{
+				flag=0;
+				break;
+	        	}
+		}	
+	}
+			
+	if(!flag){
+		if(argv[1][0]!='%' || (argv[1][0]<='1'&& argv[1][0]>='9')){
+	/* if the First character of argument is other than % or a number than printing the Appropriate Message */
+			printf("%s: argument must be pid or %%jobid\n",argv[0]);
+			fflush(stdout);
+		}
+		else{
+			printf("%s: No such job\n",argv[1]);			/* checking for any violations in the second argument */
+			fflush(stdout);
+		}	
+	}else{
+		if(cd==1){
+		/* If the User Inputed a JID as Second Argument */
+			p=getjobjid(&jobs,pid);							/* Getting the job for jid provided from user using jobs table */
+			if(p==NULL){								/* if there is no job with jid provided printing the error */
+				printf("%s: No such job\n",argv[1]);
+				fflush(stdout);
+			}else{	
+		/* if jid is correct changing the state accordingly and if the state is changed to FG then Waiting for the Process to be completed */
+	/* If the State is ST i.e. Stopped then sending the SIGCONT Signal to the Whole Process Group (done by -(p->pid)) and changing the State as per the user input */
+				if(p->state==ST){
+					if(strcmp(argv[0],"bg")==0){
+						setjobstate(&jobs,p,BG);
+						schedjob(p);
+						signaljob(p,SIGCONT);
+						printf("[%d] (%d) %s",pid,p->pid,p->cmdline);
+						fflush(stdout);	
+					}else{
+						setjobstate(&jobs,p,FG);
+						schedjob(p);
+						signaljob(p,SIGCONT);
+						waitfg(p->pid);
+					}	
+				}else if(p->state==BG){
+					if(strcmp(argv[0],"fg")==0){
+						setjobstate(&jobs,p,FG);
+						schedjob(p);
+						waitfg(p->pid);
+                                        }	
+				}else if(p->state==QU){
+	/* If the State is QU i.e. Queued then starting it right away, ahead of the admission queue */
+					fflush(stdout);
+					if(strcmp(argv[0],"bg")==0){
+						if(admitjob(p,BG,&childmask)){
+							printf("[%d] (%d) %s",pid,p->pid,p->cmdline);
+							fflush(stdout);
+						}
+					}else if(admitjob(p,FG,&childmask)){
+						waitfg(p->pid);
+					}
+				}
+							
+			}
+		}else{
+		/* If the User Inputed a PID as Second Argument */	
+			p=getjobpid(&jobs,pid);							/* Getting the job for pid provided from user from jobs table */
+			if(p==NULL){								/* if there is no job with pid provided printing the error */
+				printf("(%s): No such process\n",argv[1]);
+				fflush(stdout);
+			}else{								
+		/* if pid is correct changing the state accordingly and if the state is changed to FG then Waiting for the Process to be completed */
+	/* If the State is ST i.e. Stopped then sending the SIGCONT Signal to the Whole Process Group (done by -(p->pid)) and changing the State as per the user input */
+				if(p->state==ST){
+					if(strcmp(argv[0],"bg")==0){
+						setjobstate(&jobs,p,BG);
+						schedjob(p);
+						signaljob(p,SIGCONT);
+						printf("[%d] (%d) %s",pid,p->pid,p->cmdline);
+						fflush(stdout);
+					}else if(strcmp(argv[0],"fg")==0){
+						setjobstate(&jobs,p,FG);
+						schedjob(p);
+						signaljob(p,SIGCONT);
+						waitfg(p->pid);
+					}	
+				}else if(p->state==BG){
+					if(strcmp(argv[0],"fg")==0){
+						setjobstate(&jobs,p,FG);
+						schedjob(p);
+						waitfg(p->pid);
+                                        }	
+				}
+			}
+		}
+	}
+    }	
+    admitjobs();										/* A job may have left the BG state */
+    return;
+}
+
+/*
+ * do_hash - Execute the builtin hash command
+ *
+ *    hash          list the cached commands and their hit counts
+ *    hash -r       forget every cached command
+ *    hash name...  look up each name and remember where it was found
+ */
+void do_hash(char **argv)
+{
+    struct cmdhash_t *h;
+    int i, empty = 1;
+
+    if(argv[1]!=NULL && strcmp(argv[1],"-r")==0){
+	clearhash();
+	return;
+    }
+    if(argv[1]!=NULL){
+	for(i = 1; argv[i] != NULL; i++){
+		if(strchr(argv[i],'/')==NULL && findcmd(argv[i])==NULL)
+			printf("hash: %s: not found\n",argv[i]);
+	}
+	return;
+    }
+    findcmd("");									/* Drop the cache if PATH has changed */
+    for(i = 0; i < HASHSIZE; i++){
+	for(h = cmdhash[i]; h != NULL; h = h->next){
+		if(empty)
+			printf("hits\tcommand\n");
+		printf("%4d\t%s\n",h->hits,h->path);
+		empty=0;
+	}
+    }
+    if(empty)
+	printf("hash: hash table empty\n");
+}
+
+/*
+ * quoteword - Write the word w at p, in single quotes unless it is
+ *    only plain characters, so that parseline gives back the same
+ *    word and never an operator or a $ expansion. Return the end.
+ */
+static char *quoteword(char *p, const char *w)
+{
+    const char *s;
+
+    for (s = w; cclass[(unsigned char)*s] == 0; s++)
+	;
+    if (*s == '\0' && s > w)
+	return stpcpy(p, w);
+    *p++ = '\'';
+    for (s = w; *s != '\0'; s++) {
+	if (*s == '\'')
+	    p = stpcpy(p, "'\\''");		/* ' becomes '\'' */
+	else
+	    *p++ = *s;
+    }
+    *p++ = '\'';
+    return p;
+}
+
+/*
+ * do_parallel - Execute the builtin parallel command
+ *
+ *    parallel [-j n] -f file               run each line of file
+ *    parallel [-j n] cmd [arg...] ::: a... run cmd once for each a,
+ *                                          with {} in the args replaced
+ *                                          by a (or a appended)
+ *
+ * Each a is data: it stays part of one word, however many blanks,
+ * quotes or operator characters it holds, and the words of cmd keep
+ * the quoting they had.
+ *
+ * Keeps n commands (default: one per CPU) running at once and starts
+ * the next as soon as the event loop has reaped a finished one (see
+ * dispatchpar). The builtin returns at once and the prompt stays live:
+ * each command is an ordinary background job, so jobs, fg, bg and kill
+ * work on it, and wait waits for the run. A stopped command keeps its
+ * slot until it is continued or killed. ctrl-c with no foreground job
+ * stops the dispatch and interrupts the running commands. The report
+ * at the end counts commands that exited non-zero apart from lines
+ * that could not be started at all.
+ */
+void do_parallel(char **argv)
+{
+    char **lines=NULL, *line=NULL, *word, *w, *q, *p;
+    size_t cap=0, len;
+    int i, t, k, n, nlines=0, ns, holes;
+    FILE *fp;
+
+    if(par.id!=0){
+	printf("parallel: a run is already going\n");
+	exitstatus=1;
+	return;
+    }
+    n=sysconf(_SC_NPROCESSORS_ONLN);
+    i=1;
+    if(argv[i]!=NULL && strcmp(argv[i],"-j")==0){
+	if(argv[i+1]==NULL || (n=atoi(argv[i+1]))<1){
+		printf("parallel: -j requires a positive number\n");
+		return;
+	}
+	i+=2;
+    }
+    if(argv[i]==NULL){
+	printf("usage: parallel [-j n] -f file | cmd [arg...] ::: arg...\n");
+	return;
+    }
+
+    /* Build all the command lines first: parsing them reuses argv's storage */
+    if(strcmp(argv[i],"-f")==0){
+	if(argv[i+1]==NULL || (fp=fopen(argv[i+1],"r"))==NULL){
+		printf("parallel: cannot read %s\n",argv[i+1]?argv[i+1]:"command list");
+		return;
+	}
+	while(getline(&line,&cap,fp)>=0){
+		if(strspn(line," \t\n")==strlen(line))				/* Skip blank lines */
+			continue;
+		if((lines=realloc(lines,(nlines+1)*sizeof(char *)))==NULL ||
+		   (lines[nlines++]=strdup(line))==NULL)
+			unix_error("parallel error");
+	}
+	free(line);
+	fclose(fp);
+    }else{
+	for(t=i;argv[t]!=NULL && strcmp(argv[t],":::")!=0;t++)
+		;
+	if(argv[t]==NULL){
+		printf("parallel: missing ::: argument list\n");
+		return;
+	}
+	for(k=t+1;argv[k]!=NULL;k++)
+		;
+	if((lines=malloc((k-t)*sizeof(char *)))==NULL)
+		unix_error("parallel error");
+	for(k=t+1;argv[k]!=NULL;k++){
+		for(len=2,holes=0,ns=i;ns<t;ns++){					/* Size the line: a quoted word takes at most 4 bytes a byte, plus 3 */
+			for(q=argv[ns];(q=strstr(q,"{}"))!=NULL;q+=2)
+				holes++;
+			len+=4*strlen(argv[ns])+3;
+		}
+		len+=(holes?holes:1)*4*strlen(argv[k])+3;
+		if((line=malloc(len))==NULL || (word=malloc(len))==NULL)
+			unix_error("parallel error");
+		p=line;
+		for(ns=i;ns<t;ns++){							/* Template words with {} replaced, each quoted */
+			word[0]='\0';
+			for(w=argv[ns];(q=strstr(w,"{}"))!=NULL;w=q+2){
+				strncat(word,w,q-w);
+				strcat(word,argv[k]);
+			}
+			strcat(word,w);
+			p=quoteword(p,word);
+			*p++=' ';
+		}
+		if(!holes)
+			p=quoteword(p,argv[k]);
+		strcpy(p,"\n");
+		free(word);
+		lines[nlines++]=line;
+	}
+    }
+
+    par.id=1;
+    par.n=n;
+    par.lines=lines;
+    par.nlines=nlines;
+    par.next=par.started=par.nostart=par.killed=0;
+    par.running=par.done=par.failed=0;
+    par.intr=0;
+    clock_gettime(CLOCK_MONOTONIC, &par.t0);
+    dispatchpar();
+}
+
+/*
+ * dispatchpar - Start the parallel run's next commands while fewer
+ *    than n of them are running, and report on the run once its last
+ *    command has finished. Called again from the event loop whenever
+ *    a child is reaped or ctrl-c is typed.
+ */
+void dispatchpar(void)
+{
+    char **av;
+    int *st, ns, nr, sub;
+    struct redir_t *rd;
+    struct job_t *job;
+    struct timespec t1;
+    double secs;
+
+    if(par.id==0)										/* No run going */
+	return;
+    while(!par.intr && par.running<par.n && par.next<par.nlines){
+	job=NULL;
+	fflush(stdout);
+	if(parseline(par.lines[par.next],&av)!=-1 && (ns=splitpipeline(av,&st))>0 &&
+	   (nr=splitredirs(av,st,ns,&rd))>=0)
+		job=startjob(av,st,ns,rd,nr,par.lines[par.next],BG,&childmask);
+	if(job!=NULL){
+		job->group=par.id;
+		par.running++;
+		par.started++;
+	}else{
+		par.nostart++;								/* Bad syntax or no such command */
+	}
+	par.next++;
+    }
+    if(par.intr && !par.killed){								/* ctrl-c: stop everything we started */
+	for(sub=1;sub<=maxjid(&jobs);sub++){
+		if((job=getjobjid(&jobs,sub))!=NULL && job->group==par.id){
+			signaljob(job,SIGINT);
+			signaljob(job,SIGCONT);
+		}
+	}
+	par.killed=1;
+    }
+    if(par.running>0)										/* A stopped command keeps its slot */
+	return;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs=(t1.tv_sec-par.t0.tv_sec)+(t1.tv_nsec-par.t0.tv_nsec)/1e9;
+    printf("parallel: %d jobs, %d failed, %d could not start, %d not run, %.3f s, %.1f jobs/s\n",
+	   par.started, par.failed, par.nostart, par.nlines-par.next, secs, secs>0?par.done/secs:0.0);
+    fflush(stdout);
+    for(sub=0;sub<par.nlines;sub++)
+	free(par.lines[sub]);
+    free(par.lines);
+    par.lines=NULL;
+    par.id=0;
+}
+
+/*
+ * do_admit - Execute the builtin admit command
+ *
+ *    admit           show the limit and the queue
+ *    admit n         run at most n background jobs at once
+ *    admit cpus      ... at most one per online CPU
+ *    admit psi [n]   ... n (default: one per CPU), scaled down by the
+ *                    CPU pressure in /proc/pressure/cpu
+ *    admit off       start background jobs at once (the default)
+ *    admit drain     wait for the queue and the background jobs
+ *
+ * Background jobs beyond the limit are queued in the Queued state and
+ * started in submission order as running jobs finish or stop.
+ */
+void do_admit(char **argv)
+{
+    int n;
+
+    if(argv[1]==NULL){
+	;
+    }else if(strcmp(argv[1],"off")==0){
+	admit.mode=ADMIT_OFF;
+    }else if(strcmp(argv[1],"cpus")==0){
+	admit.mode=ADMIT_CPUS;
+	admit.base=sysconf(_SC_NPROCESSORS_ONLN);
+    }else if(strcmp(argv[1],"psi")==0){
+	admit.mode=ADMIT_PSI;
+	admit.base=argv[2]?atoi(argv[2]):sysconf(_SC_NPROCESSORS_ONLN);
+	admit.psitime=0;
+	if(admit.base<1 || access("/proc/pressure/cpu",R_OK)<0){
+		printf("admit: %s\n",admit.base<1?"limit must be positive":"no CPU pressure information");
+		admit.mode=ADMIT_OFF;
+		return;
+	}
+    }else if(strcmp(argv[1],"drain")==0){
+	drainjobs(1);
+    }else if((n=atoi(argv[1]))>0){
+	admit.mode=ADMIT_FIXED;
+	admit.base=n;
+    }else{
+	printf("usage: admit [n | cpus | psi [n] | off | drain]\n");
+	return;
+    }
+    drainjobs(-1);									/* Start what the new limit allows */
+    if(admit.mode==ADMIT_OFF)
+	printf("admit: off");
+    else
+	printf("admit: limit %d",admitlimit());
+    printf(", running %d, queued %d, peak %d, submitted %ld, admitted %ld\n",
+	   jobs.nbg, admit.nqueued, admit.peak, admit.submitted, admit.admitted);
+}
+
+/*
+ * do_times - Execute the builtin times command: print the CPU time
+ *    used by the shell and by its reaped children, and the resources
+ *    used by the last MAXDONE jobs that finished.
+ */
+void do_times(char **argv)
+{
+    struct tms t;
+    struct jobstat_t *js;
+    long first, i, n;
+    double tick = sysconf(_SC_CLK_TCK);
+
+    times(&t);
+    printf("shell     user %.3fs  sys %.3fs\n", t.tms_utime/tick, t.tms_stime/tick);
+    printf("children  user %.3fs  sys %.3fs\n", t.tms_cutime/tick, t.tms_cstime/tick);
+
+    n = ndone;
+    first = n > MAXDONE ? n - MAXDONE : 0;
+    if (n > 0)
+	printf("last %ld of %ld finished jobs:\n", n - first, n);
+    for (i = first; i < n; i++) {
+	js = &donejobs[i % MAXDONE];
+	printf("[%d] (%d) ", js->jid, js->pid);
+	if (WIFEXITED(js->status))
+	    printf("exit %d  ", WEXITSTATUS(js->status));
+	else
+	    printf("signal %d  ", WTERMSIG(js->status));
+	printf("wall %.3fs  ", tsdiff(&js->start, &js->end));
+	printrusage(&js->ru);
+	printf("  %s\n", js->cmdline);
+    }
+}
+
+/*
+ * do_plan - Execute the builtin plan command
+ *
+ *    plan          show the size of the plan cache and its hit rate
+ *    plan -l       ... and list the cached lines, most recent first
+ *    plan -r       forget every cached line
+ *    plan -n size  cache at most size lines (0 turns the cache off)
+ */
+void do_plan(char **argv)
+{
+    struct plan_t *p;
+
+    if(argv[1]!=NULL && strcmp(argv[1],"-r")==0){
+	clearplans();
+	return;
+    }
+    if(argv[1]!=NULL && strcmp(argv[1],"-n")==0){
+	if(argv[2]==NULL || !isdigit((unsigned char)argv[2][0])){
+		printf("plan: -n requires a number\n");
+		return;
+	}
+	clearplans();
+	plans.max=atoi(argv[2]);
+	free(plans.buckets);								/* Sized for the new limit on the next insert */
+	plans.buckets=NULL;
+	plans.nbuckets=0;
+	return;
+    }
+    if(argv[1]!=NULL && strcmp(argv[1],"-l")!=0){
+	printf("usage: plan [-l | -r | -n size]\n");
+	return;
+    }
+    printf("plan: %d of %d lines cached, %ld hits, %ld misses, %ld evictions\n",
+	   plans.n,plans.max,plans.hits,plans.misses,plans.evictions);
+    if(argv[1]!=NULL){
+	for(p=plans.head;p!=NULL;p=p->next)
+		printf("%6ld\t%s",p->hits,p->line);
+    }
+}
+
+/*
+ * putesc - Print the character of the backslash escape that starts
+ *    at *sp (just past the backslash) and step over it. Octal escapes
+ *    are \0nnn for echo and \nnn for printf; anything that is not an
+ *    escape is printed as it is. Return 1 for \c, which ends the output.
+ */
+static int putesc(char **sp, int echo)
+{
+    char *s = *sp;
+    int c, n;
+
+    switch (c = *s++) {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'c': *sp = s; return 1;
+    case 'e': c = 033; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': break;
+    case '\0':			/* a backslash at the end */
+	s--;
+	c = '\\';
+	break;
+    case 'x':
+	if (!isxdigit((unsigned char)*s)) {
+	    putchar('\\');
+	    break;
+	}
+	for (c = 0, n = 0; n < 2 && isxdigit((unsigned char)*s); n++, s++)
+	    c = c * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+	break;
+    default:
+	if (c >= '0' && c <= '7' && (c == '0' || !echo)) {
+	    n = echo ? 0 : 1;
+	    for (c = echo ? 0 : c - '0'; n < 3 && *s >= '0' && *s <= '7'; n++)
+		c = c * 8 + *s++ - '0';
+	    break;
+	}
+	putchar('\\');
+	break;
+    }
+    putchar(c);
+    *sp = s;
+    return 0;
+}
+
+/*
+ * do_echo - Execute the builtin echo command
+ *
+ *    echo [-neE] [arg...]   print the args; -n leaves out the newline,
+ *                           -e interprets backslash escapes (-E not)
+ */
+void do_echo(char **argv)
+{
+    int i, first, esc = 0, nl = 1, stop = 0;
+    char *s;
+
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0' &&
+	     argv[i][strspn(argv[i] + 1, "neE") + 1] == '\0'; i++) {
+	for (s = argv[i] + 1; *s; s++) {
+	    if (*s == 'n')
+		nl = 0;
+	    else
+		esc = *s == 'e';
+	}
+    }
+    for (first = i; argv[i] != NULL && !stop; i++) {
+	if (i > first)
+	    putchar(' ');
+	if (!esc) {
+	    fputs(argv[i], stdout);
+	    continue;
+	}
+	for (s = argv[i]; *s != '\0' && !stop; ) {
+	    if (*s != '\\')
+		putchar(*s++);
+	    else {
+		s++;
+		stop = putesc(&s, 1);
+	    }
+	}
+    }
+    if (nl && !stop)
+	putchar('\n');
+}
+
+/* do_true, do_false - Execute the builtin true and false commands */
+void do_true(char **argv)
+{
+    exitstatus = 0;
+}
+
+void do_false(char **argv)
+{
+    exitstatus = 1;
+}
+
+/*
+ * do_printf - Execute the builtin printf command
+ *
+ *    printf format [arg...]
+ *
+ * The format takes backslash escapes and the conversions %d %i %u
+ * %o %x %X %c %s %b and %%, with flags, a width and a precision. The
+ * format is used again while there are args left; missing args are
+ * taken as empty strings and zeros.
+ */
+void do_printf(char **argv)
+{
+    char spec[64], *s, *arg, *end;
+    int i = 2, start, n, c;
+    long long num;
+
+    if (argv[1] == NULL) {
+	printf("usage: printf format [arg...]\n");
+	exitstatus = 1;
+	return;
+    }
+    do {
+	start = i;
+	for (s = argv[1]; *s != '\0'; ) {
+	    if (*s == '\\') {
+		s++;
+		if (putesc(&s, 0))
+		    return;
+		continue;
+	    }
+	    if (*s != '%') {
+		putchar(*s++);
+		continue;
+	    }
+	    if (s[1] == '%') {
+		putchar('%');
+		s += 2;
+		continue;
+	    }
+	    n = 1 + strspn(s + 1, "-+ #0");
+	    n += strspn(s + n, "0123456789");
+	    if (s[n] == '.')
+		n += 1 + strspn(s + n + 1, "0123456789");
+	    c = s[n];
+	    if (c == '\0' || strchr("diuoxXcsb", c) == NULL || n > (int)sizeof(spec) - 4) {
+		printf("printf: %.*s: invalid conversion\n", c ? n + 1 : n, s);
+		exitstatus = 1;
+		return;
+	    }
+	    memcpy(spec, s, n);
+	    arg = argv[i] != NULL ? argv[i++] : NULL;
+	    s += n + 1;
+	    switch (c) {
+	    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		errno = 0;
+		if (arg == NULL)
+		    arg = "0";
+		if (c == 'd' || c == 'i')
+		    num = strtoll(arg, &end, 0);
+		else
+		    num = strtoull(arg, &end, 0);
+		if (*end != '\0' || end == arg || errno != 0) {
+		    printf("printf: %s: invalid number\n", arg);
+		    exitstatus = 1;
+		}
+		strcpy(spec + n, c == 'i' ? "lld" : (char []){ 'l', 'l', c, '\0' });
+		printf(spec, num);
+		break;
+	    case 'c':
+		if (arg != NULL && *arg != '\0') {
+		    strcpy(spec + n, "c");
+		    printf(spec, *arg);
+		}
+		break;
+	    case 's':
+		strcpy(spec + n, "s");
+		printf(spec, arg ? arg : "");
+		break;
+	    case 'b':
+		for (; arg != NULL && *arg != '\0'; ) {
+		    if (*arg != '\\')
+			putchar(*arg++);
+		    else {
+			arg++;
+			if (putesc(&arg, 1))
+			    return;
+		    }
+		}
+		break;
+	    }
+	}
+    } while (argv[i] != NULL && i > start);
+}
+
+/*
+ * do_cd - Execute the builtin cd command
+ *
+ *    cd [dir]   change to dir (default: $HOME); cd - goes back to the
+ *               previous directory. PWD and OLDPWD are updated.
+ */
+void do_cd(char **argv)
+{
+    char *dir = argv[1], *old, *cwd, *p;
+
+    if (dir == NULL && (dir = getvar("HOME", 4)) == NULL) {
+	printf("cd: HOME not set\n");
+	exitstatus = 1;
+	return;
+    }
+    if (strcmp(dir, "-") == 0) {
+	if ((dir = getvar("OLDPWD", 6)) == NULL) {
+	    printf("cd: OLDPWD not set\n");
+	    exitstatus = 1;
+	    return;
+	}
+	printf("%s\n", dir);
+    }
+    old = getcwd(NULL, 0);
+    if (chdir(dir) < 0) {
+	printf("cd: %s: %s\n", dir, strerror(errno));
+	exitstatus = 1;
+	free(old);
+	return;
+    }
+    if (old != NULL)
+	setvar("OLDPWD", 6, old, 1);
+    if ((cwd = getcwd(NULL, 0)) != NULL)
+	setvar("PWD", 3, cwd, 1);
+    free(old);
+    free(cwd);
+
+    /* Commands found through a relative PATH entry are elsewhere now */
+    for (p = hashpath; p != NULL; p = strchr(p, ':') ? strchr(p, ':') + 1 : NULL) {
+	if (*p != '/') {
+	    clearhash();
+	    break;
+	}
+    }
+}
+
+/*
+ * do_pwd - Execute the builtin pwd command
+ */
+void do_pwd(char **argv)
+{
+    char *cwd;
+
+    if ((cwd = getcwd(NULL, 0)) == NULL) {
+	printf("pwd: %s\n", strerror(errno));
+	exitstatus = 1;
+	return;
+    }
+    printf("%s\n", cwd);
+    free(cwd);
+}
+
+static const struct {       /* Signal names for kill */
+    char *name;
+    int sig;
+} signames[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 }, { "SEGV", SIGSEGV }, { "USR2", SIGUSR2 }, { "PIPE", SIGPIPE },
+    { "ALRM", SIGALRM }, { "TERM", SIGTERM }, { "CHLD", SIGCHLD }, { "CONT", SIGCONT },
+    { "STOP", SIGSTOP }, { "TSTP", SIGTSTP }, { "TTIN", SIGTTIN }, { "TTOU", SIGTTOU },
+    { "WINCH", SIGWINCH },
+};
+#define NSIGNAMES (int)(sizeof(signames) / sizeof(signames[0]))
+
+/* signum - The signal called name (INT, SIGINT or 2), or -1 */
+static int signum(char *name)
+{
+    char *end;
+    long n;
+    int i;
+
+    if (isdigit((unsigned char)*name)) {
+	n = strtol(name, &end, 10);
+	return *end == '\0' && n < NSIG ? n : -1;
+    }
+    if (strncmp(name, "SIG", 3) == 0)
+	name += 3;
+    for (i = 0; i < NSIGNAMES; i++)
+	if (strcmp(name, signames[i].name) == 0)
+	    return signames[i].sig;
+    return -1;
+}
+
+/*
+ * do_kill - Execute the builtin kill command
+ *
+ *    kill [-s sig | -sig] %jid|pid...   send sig (default TERM) to each
+ *                                       job or process
+ *    kill -l                            list the signal names
+ *
+ * A job is signalled as a whole process group. Like other shells,
+ * a stopped job that is sent TERM or HUP is also sent CONT, so that
+ * it can act on it.
+ */
+void do_kill(char **argv)
+{
+    struct job_t *job;
+    char *end;
+    int i = 1, sig = SIGTERM;
+    long id;
+
+    if (argv[1] != NULL && strcmp(argv[1], "-l") == 0) {
+	for (i = 0; i < NSIGNAMES; i++)
+	    printf("%2d) SIG%s\n", signames[i].sig, signames[i].name);
+	return;
+    }
+    if (argv[i] != NULL && strcmp(argv[i], "-s") == 0 && argv[i+1] != NULL) {
+	sig = signum(argv[i+1]);
+	i += 2;
+    }
+    else if (argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0') {
+	sig = signum(argv[i] + 1);
+	i++;
+    }
+    if (sig < 0 || argv[i] == NULL) {
+	printf(sig < 0 ? "kill: invalid signal\n" : "usage: kill [-s sig | -sig] %%jid|pid...\n");
+	exitstatus = 1;
+	return;
+    }
+    for (; argv[i] != NULL; i++) {
+	id = strtol(argv[i] + (argv[i][0] == '%'), &end, 10);
+	if (*end != '\0' || end == argv[i] + (argv[i][0] == '%') || id <= 0) {
+	    printf("kill: %s: argument must be a PID or %%jobid\n", argv[i]);
+	    exitstatus = 1;
+	    continue;
+	}
+	if (argv[i][0] != '%') {
+	    if (kill(id, sig) < 0) {
+		printf("kill: (%ld) - %s\n", id, strerror(errno));
+		exitstatus = 1;
+	    }
+	    continue;
+	}
+	if ((job = getjobjid(&jobs, id)) == NULL || job->state == QU) {
+	    printf("%s: %s\n", argv[i], job ? "Job has not started" : "No such job");
+	    exitstatus = 1;
+	    continue;
+	}
+	traceevent(EV_RELAY, 'i', sig, job->pid);
+	signaljob(job, sig);
+	if (job->state == ST && (sig == SIGTERM || sig == SIGHUP))
+	    signaljob(job, SIGCONT);
+    }
+}
+
+/* jobstatus - The exit status recorded for the finished job with this PID */
+static int jobstatus(pid_t pid)
+{
+    long i;
+
+    for (i = ndone - 1; i >= 0 && i >= ndone - MAXDONE; i--) {
+	if (donejobs[i % MAXDONE].pid == pid) {
+	    i = donejobs[i % MAXDONE].status;
+	    return WIFEXITED(i) ? WEXITSTATUS(i) : 128 + WTERMSIG(i);
+	}
+    }
+    return 127;
+}
+
+/*
+ * waitstep - Handle the next event, unless ctrl-c was typed or the
+ *    deadline (CLOCK_MONOTONIC ns, or -1 for none) has passed, in
+ *    which case return 0 without waiting.
+ */
+static int waitstep(long long deadline)
+{
+    struct timespec ts;
+    long long left;
+
+    if (intr)
+	return 0;
+    if (deadline < 0) {
+	waitevent(0, -1);
+	return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    left = deadline - (ts.tv_sec * 1000000000LL + ts.tv_nsec);
+    if (left <= 0)
+	return 0;
+    waitevent(0, (int)((left + 999999) / 1000000));
+    return 1;
+}
+
+/*
+ * waitjob - Resolve a wait argument (%jid or PID) to a job. If there is
+ *    no such job, set the exit status and return NULL; *done is set if
+ *    it is the PID of a job that has finished already, whose status
+ *    the exit status is then.
+ */
+static struct job_t *waitjob(char *arg, int *done)
+{
+    struct job_t *job;
+    char *end;
+    long id;
+
+    *done = 0;
+    id = strtol(arg + (arg[0] == '%'), &end, 10);
+    if (*end != '\0' || end == arg + (arg[0] == '%') || id <= 0) {
+	printf("wait: %s: argument must be a PID or %%jobid\n", arg);
+	exitstatus = 1;
+	return NULL;
+    }
+    job = arg[0] == '%' ? getjobjid(&jobs, id) : getjobpid(&jobs, id);
+    if (job == NULL) {
+	if (arg[0] == '%')
+	    printf("%s: No such job\n", arg);
+	exitstatus = jobstatus(id);
+	*done = arg[0] != '%' && exitstatus != 127;
+	if (arg[0] == '%')
+	    exitstatus = 127;
+    }
+    return job;
+}
+
+/*
+ * waitany - wait -n: wait until one of the n jobs in jids (any job if
+ *    jids is NULL) finishes, and set the exit status to its own.
+ */
+static void waitany(int *jids, int n, long long deadline)
+{
+    struct job_t *job;
+    long seen = ndone, i;
+    int k, status, live;
+
+    while (1) {
+	for (i = seen; i < ndone; i++) {	/* jobs finished since the last look */
+	    status = donejobs[i % MAXDONE].status;
+	    for (k = 0; jids != NULL && k < n; k++)
+		if (jids[k] == donejobs[i % MAXDONE].jid)
+		    break;
+	    if (jids == NULL || k < n) {
+		exitstatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		return;
+	    }
+	}
+	seen = ndone;
+	live = jids == NULL && (admit.head != NULL || jobs.nbg > 0);
+	for (k = 0; jids != NULL && k < n && !live; k++)
+	    live = (job = getjobjid(&jobs, jids[k])) != NULL && job->state != ST;
+	if (!live) {
+	    exitstatus = 127;
+	    return;
+	}
+	if (!waitstep(deadline)) {
+	    exitstatus = intr ? 128 + SIGINT : 124;
+	    return;
+	}
+    }
+}
+
+/*
+ * do_wait - Execute the builtin wait command
+ *
+ *    wait [-t ms]               wait for every background job
+ *    wait [-t ms] %jid|pid...   wait for these jobs, and set the exit
+ *                               status to the last one's
+ *    wait -n [-t ms] [%jid|pid...]
+ *                               wait for any one job (of these), and
+ *                               set the exit status to its own, or to
+ *                               127 if there is none to wait for
+ *
+ * A job that stops is no longer waited for. ctrl-c stops the wait; so
+ * does the end of the -t timeout, with exit status 124. The wait sleeps
+ * in the event loop, so it wakes up as soon as a child is reaped. The
+ * notices of background jobs killed meanwhile are printed when it ends.
+ */
+void do_wait(char **argv)
+{
+    struct job_t *job;
+    struct timespec ts;
+    long long deadline = -1;
+    int i, n, done, any = 0, timedout = 0, *jids;
+    long ms;
+    char *end;
+    pid_t pid = 0;
+
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-'; i++) {
+	if (strcmp(argv[i], "-n") == 0)
+	    any = 1;
+	else if (strcmp(argv[i], "-t") == 0 && argv[i+1] != NULL &&
+		 (ms = strtol(argv[i+1], &end, 10)) >= 0 && *end == '\0' && end != argv[i+1]) {
+	    clock_gettime(CLOCK_MONOTONIC, &ts);
+	    deadline = ts.tv_sec * 1000000000LL + ts.tv_nsec + ms * 1000000LL;
+	    i++;
+	}
+	else {
+	    printf("wait: usage: wait [-n] [-t ms] [%%jid|pid ...]\n");
+	    exitstatus = 2;
+	    return;
+	}
+    }
+    argv += i - 1;
+    intr = 0;
+
+    if (any) {
+	for (n = 0; argv[n+1] != NULL; n++)
+	    ;
+	if ((jids = malloc((n + 1) * sizeof(int))) == NULL)
+	    unix_error("malloc error");
+	for (i = 1, n = 0, done = 0; argv[i] != NULL && !done; i++)
+	    if ((job = waitjob(argv[i], &done)) != NULL)
+		jids[n++] = job->jid;
+	if (!done)			/* else that one has finished already */
+	    waitany(argv[1] == NULL ? NULL : jids, n, deadline);
+	free(jids);
+    }
+    else if (argv[1] == NULL) {
+	while ((admit.head != NULL || jobs.nbg > 0) && waitstep(deadline))
+	    ;
+	exitstatus = intr ? 128 + SIGINT : admit.head != NULL || jobs.nbg > 0 ? 124 : 0;
+    }
+    for (i = 1; !any && argv[i] != NULL && !intr && !timedout; i++) {
+	if ((job = waitjob(argv[i], &done)) == NULL)
+	    continue;
+	n = job->jid;			/* a queued job has no PID until it is admitted */
+	while ((job = getjobjid(&jobs, n)) != NULL && job->state != ST) {
+	    pid = job->pid;
+	    if (!waitstep(deadline))
+		break;
+	}
+	if (job == NULL)
+	    exitstatus = jobstatus(pid);
+	else if (job->state == ST)
+	    exitstatus = 128 + SIGTSTP;
+	else {
+	    exitstatus = intr ? 128 + SIGINT : 124;
+	    timedout = !intr;
+	}
+    }
+    flushnotices();
+}
+
+/* isbinop - Is op a binary operator of test? */
+static int isbinop(char *op)
+{
+    static char *ops[] = { "=", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++)
+	if (strcmp(op, ops[i]) == 0)
+	    return 1;
+    return 0;
+}
+
+/* testexpr - Evaluate the n args of test: 1 if true, 0 if false, -1 on an error */
+static int testexpr(char **av, int n)
+{
+    struct stat st;
+    char *end1, *end2;
+    long a, b;
+    int r;
+
+    if (n >= 2 && n <= 4 && strcmp(av[0], "!") == 0 && !(n == 3 && isbinop(av[1]))) {
+	r = testexpr(av + 1, n - 1);
+	return r < 0 ? r : !r;
+    }
+    switch (n) {
+    case 0:
+	return 0;
+    case 1:
+	return av[0][0] != '\0';
+    case 2:
+	if (av[0][0] != '-' || av[0][1] == '\0' || av[0][2] != '\0')
+	    break;
+	switch (av[0][1]) {
+	case 'n': return av[1][0] != '\0';
+	case 'z': return av[1][0] == '\0';
+	case 't': return isatty(atoi(av[1]));
+	case 'r': return access(av[1], R_OK) == 0;
+	case 'w': return access(av[1], W_OK) == 0;
+	case 'x': return access(av[1], X_OK) == 0;
+	case 'h': case 'L':
+	    return lstat(av[1], &st) == 0 && S_ISLNK(st.st_mode);
+	}
+	if (strchr("efdbcpSs", av[0][1]) == NULL)
+	    break;
+	if (stat(av[1], &st) < 0)
+	    return 0;
+	switch (av[0][1]) {
+	case 'e': return 1;
+	case 'f': return S_ISREG(st.st_mode);
+	case 'd': return S_ISDIR(st.st_mode);
+	case 'b': return S_ISBLK(st.st_mode);
+	case 'c': return S_ISCHR(st.st_mode);
+	case 'p': return S_ISFIFO(st.st_mode);
+	case 'S': return S_ISSOCK(st.st_mode);
+	case 's': return st.st_size > 0;
+	}
+	break;
+    case 3:
+	if (!isbinop(av[1])) {
+	    if (strcmp(av[0], "(") == 0 && strcmp(av[2], ")") == 0)
+		return testexpr(av + 1, 1);
+	    break;
+	}
+	if (strcmp(av[1], "=") == 0)
+	    return strcmp(av[0], av[2]) == 0;
+	if (strcmp(av[1], "!=") == 0)
+	    return strcmp(av[0], av[2]) != 0;
+	a = strtol(av[0], &end1, 10);
+	b = strtol(av[2], &end2, 10);
+	if (*end1 != '\0' || *end2 != '\0' || end1 == av[0] || end2 == av[2]) {
+	    printf("test: integer expression expected\n");
+	    return -1;
+	}
+	if (strcmp(av[1], "-eq") == 0) return a == b;
+	if (strcmp(av[1], "-ne") == 0) return a != b;
+	if (strcmp(av[1], "-lt") == 0) return a < b;
+	if (strcmp(av[1], "-le") == 0) return a <= b;
+	if (strcmp(av[1], "-gt") == 0) return a > b;
+	return a >= b;
+    }
+    printf("test: unknown expression\n");
+    return -1;
+}
+
+/*
+ * do_test - Execute the builtin test (or [) command
+ *
+ *    test expr   or   [ expr ]
+ *
+ * Sets the exit status to 0 if expr is true, 1 if it is false and 2
+ * if it is not understood. expr has at most four args, as in POSIX:
+ * !, the unary file tests -e -f -d -b -c -p -S -s -h -L -r -w -x,
+ * -n -z and -t, and the binary = != -eq -ne -lt -le -gt -ge.
+ */
+void do_test(char **argv)
+{
+    int n, r;
+
+    for (n = 0; argv[n + 1] != NULL; n++)
+	;
+    if (strcmp(argv[0], "[") == 0) {
+	if (n == 0 || strcmp(argv[n], "]") != 0) {
+	    printf("[: missing ']'\n");
+	    exitstatus = 2;
+	    return;
+	}
+	n--;
+    }
+    r = testexpr(argv + 1, n);
+    exitstatus = r < 0 ? 2 : !r;
+}
+
+/*
+ * copyfd - Copy in to out until end of file, without going through
+ *    user space when the kernel can do it: copy_file_range between
+ *    regular files, splice when either end is a pipe, sendfile from a
+ *    regular file. Anything else (or a kernel that refuses before the
+ *    first byte) falls back to read and write. The copy goes in chunks
+ *    so that ctrl-c can stop it. Return 0, or -1 with errno set.
+ */
+static int copyfd(int in, int out)
+{
+    static char buf[128 << 10];
+    struct stat si, so;
+    ssize_t n, w, k, done;
+    size_t chunk = 64 << 20;
+    int mode;				/* 0 read, 1 copy_file_range, 2 splice, 3 sendfile */
+
+    if (fstat(in, &si) < 0 || fstat(out, &so) < 0)
+	return -1;
+    mode = S_ISREG(si.st_mode) && S_ISREG(so.st_mode) ? 1 :
+	S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode) ? 2 :
+	S_ISREG(si.st_mode) ? 3 : 0;
+
+    for (done = 0; ; done += n) {
+	handlesignals();
+	if (intr) {
+	    errno = EINTR;
+	    return -1;
+	}
+	switch (mode) {
+	case 1:
+	    n = copy_file_range(in, NULL, out, NULL, chunk, 0);
+	    break;
+	case 2:
+	    n = splice(in, NULL, out, NULL, chunk, SPLICE_F_MOVE);
+	    break;
+	case 3:
+	    n = sendfile(out, in, NULL, chunk);
+	    break;
+	default:
+	    if ((n = read(in, buf, sizeof(buf))) <= 0)
+		break;
+	    for (w = 0; w < n; w += k)
+		if ((k = write(out, buf + w, n - w)) < 0)
+		    return -1;
+	}
+	if (n == 0)
+	    return 0;
+	if (n < 0) {
+	    if (errno == EINTR)
+		n = 0;
+	    else if (mode != 0 && done == 0 &&
+		     (errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP ||
+		      errno == ENOSYS || errno == EBADF)) {
+		mode = 0;
+		n = 0;
+	    }
+	    else
+		return -1;
+	}
+    }
+}
+
+/*
+ * do_cat - Execute the builtin cat command
+ *
+ *    cat [file...]   copy each file (stdin for none or -) to stdout
+ *
+ * The bytes are moved by the kernel where it can (see copyfd), so a
+ * large file is copied without a process and without a user-space
+ * buffer. Sets the exit status to 1 if a file could not be copied.
+ */
+void do_cat(char **argv)
+{
+    char *stdinv[] = { "-", NULL };
+    char **f;
+    int fd;
+
+    intr = 0;
+    exitstatus = 0;
+    fflush(stdout);
+    for (f = argv[1] != NULL ? argv + 1 : stdinv; *f != NULL && !intr; f++) {
+	if (strcmp(*f, "-") == 0)
+	    fd = STDIN_FILENO;
+	else if ((fd = open(*f, O_RDONLY | O_CLOEXEC)) < 0) {
+	    fprintf(stderr, "cat: %s: %s\n", *f, strerror(errno));
+	    exitstatus = 1;
+	    continue;
+	}
+	if (copyfd(fd, STDOUT_FILENO) < 0) {
+	    fprintf(stderr, "cat: %s: %s\n", *f, strerror(errno));
+	    exitstatus = 1;
+	}
+	if (fd != STDIN_FILENO)
+	    close(fd);
+    }
+}
+
+/*
+ * do_place - Execute the builtin pin and limit commands
+ *
+ *    pin [cpus] [-s]                   run the jobs started from now
+ *                                      on on cpus (a list like 0-3,6);
+ *                                      with -s give each background
+ *                                      job one of them (or of all the
+ *                                      CPUs), the least used
+ *    pin off                           let them run anywhere again
+ *    limit [-v size] [-t secs] [-n files]
+ *                                      give them these soft limits on
+ *                                      address space, CPU time and open
+ *                                      files (a value can be off or
+ *                                      unlimited; a size can end in K,
+ *                                      M or G)
+ *    pin ... cmd..., limit ... cmd...  run one command that way
+ *
+ * With no arguments, print the current setting. The prefix form is
+ * taken off the command line when it is parsed (see makeplan), so it
+ * never gets here.
+ */
+void do_place(char **argv)
+{
+    struct attr_t a = defattr;
+    int pin = strcmp(argv[0], "pin") == 0, i;
+
+    if (argv[1] == NULL) {
+	printf("%s", argv[0]);
+	if (pin && (a.flags & A_CPUS)) {
+	    printf(" ");
+	    printcpus(&a.cpus);
+	}
+	if (pin && (a.flags & A_SPREAD))
+	    printf(" -s");
+	if (pin && !(a.flags & (A_CPUS | A_SPREAD)))
+	    printf(" off");
+	for (i = 0; !pin && i < NLIMITS; i++)
+	    if (a.flags & (A_LIMIT << i)) {
+		printf(" -%c ", limits[i].opt);
+		printlimit(i, a.lim[i]);
+	    }
+	if (!pin && !(a.flags & (A_LIMIT * ((1 << NLIMITS) - 1))))
+	    printf(" off");
+	printf("\n");
+	return;
+    }
+    a.cpu = -1;
+    if (parseattr(argv, &a) < 0) {
+	exitstatus = 1;
+	return;
+    }
+    defattr = a;
+}
+
+/*
+ * do_bgsched - Execute the builtin bgsched command
+ *
+ *    bgsched               print the policy
+ *    bgsched off           background jobs run like foreground ones
+ *    bgsched nice [n]      they run n nicer (default 10)
+ *    bgsched batch [n]     they run with SCHED_BATCH, n nicer (default 0)
+ *    bgsched idle          they run with SCHED_IDLE
+ *
+ * The policy applies to the jobs in the background now, and to those
+ * put there later; fg takes it off a job again.
+ */
+void do_bgsched(char **argv)
+{
+    static const struct { char *name; int policy, nice; } policies[] = {
+	{ "off", -1, 0 }, { "nice", SCHED_OTHER, 10 },
+	{ "batch", SCHED_BATCH, 0 }, { "idle", SCHED_IDLE, 0 },
+    };
+    struct job_t *job;
+    char *end;
+    long n;
+    int i;
+
+    if (argv[1] == NULL) {
+	for (i = 0; policies[i].policy != bgpolicy; i++)
+	    ;
+	printf("bgsched %s", policies[i].name);
+	if (bgpolicy == SCHED_OTHER || (bgpolicy == SCHED_BATCH && bgnice != 0))
+	    printf(" %d", bgnice);
+	printf("\n");
+	return;
+    }
+    for (i = 0; i < 4 && strcmp(argv[1], policies[i].name) != 0; i++)
+	;
+    if (i == 4 || (argv[2] != NULL && (policies[i].policy == -1 || policies[i].policy == SCHED_IDLE)) ||
+	(argv[2] != NULL && argv[3] != NULL)) {
+	printf("Usage: bgsched [off | nice [n] | batch [n] | idle]\n");
+	exitstatus = 2;
+	return;
+    }
+    n = policies[i].nice;
+    if (argv[2] != NULL && ((n = strtol(argv[2], &end, 10)) < 0 || n > 39 || *end != '\0' || end == argv[2])) {
+	printf("bgsched: %s: the increment must be 0 to 39\n", argv[2]);
+	exitstatus = 1;
+	return;
+    }
+    bgpolicy = policies[i].policy;
+    bgnice = n;
+    for (i = 1; i <= jobs.maxjid; i++)
+	if ((job = jobs.byjid[i]) != NULL && job->state == BG && schedjob(job) < 0)
+	    exitstatus = 1;
+}
+
+/*
+ * do_renice - Execute the builtin renice command
+ *
+ *    renice [-n] n %jid|pid...   set the nice value of jobs, -20 to 19
+ *
+ * This is the job's own value: while it is in the background, the
+ * bgsched increment is added to it.
+ */
+void do_renice(char **argv)
+{
+    struct job_t *job;
+    char *end;
+    long n, id;
+    int i = 1;
+
+    if (argv[i] != NULL && strcmp(argv[i], "-n") == 0)
+	i++;
+    if (argv[i] == NULL || argv[i+1] == NULL) {
+	printf("Usage: renice [-n] n %%jid|pid...\n");
+	exitstatus = 2;
+	return;
+    }
+    n = strtol(argv[i], &end, 10);
+    if (*end != '\0' || end == argv[i] || n < -20 || n > 19) {
+	printf("renice: %s: the nice value must be -20 to 19\n", argv[i]);
+	exitstatus = 1;
+	return;
+    }
+    for (i++; argv[i] != NULL; i++) {
+	id = strtol(argv[i] + (argv[i][0] == '%'), &end, 10);
+	job = *end != '\0' || id <= 0 ? NULL :
+	    argv[i][0] == '%' ? getjobjid(&jobs, id) : getjobpid(&jobs, id);
+	if (job == NULL) {
+	    printf("%s: No such job\n", argv[i]);
+	    exitstatus = 1;
+	    continue;
+	}
+	job->nice = n;
+	if (schedjob(job) < 0)
+	    exitstatus = 1;
+    }
+}
+
+/*
+ * do_history - Execute the builtin history command
+ *
+ *    history [-l] [-n count] [prefix]
+ *
+ * Print the last count (default 16) lines of the history, or the last
+ * count that start with prefix, oldest first. With -l, also print when
+ * each was run, its exit status and how long it took.
+ */
+void do_history(char **argv)
+{
+    char *prefix = NULL, *end;
+    long count = 16;
+    int i, full = 0;
+
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-'; i++) {
+	if (strcmp(argv[i], "-l") == 0)
+	    full = 1;
+	else if (strcmp(argv[i], "-n") == 0 && argv[i+1] != NULL &&
+		 (count = strtol(argv[i+1], &end, 10)) > 0 && *end == '\0')
+	    i++;
+	else {
+	    printf("Usage: history [-l] [-n count] [prefix]\n");
+	    exitstatus = 2;
+	    return;
+	}
+    }
+    prefix = argv[i];
+    if (hist.fd < 0) {
+	printf("history: no history file (see -H)\n");
+	exitstatus = 1;
+	return;
+    }
+    listhist(count, prefix, full);
+}
+
+/*
+ * do_capture - Execute the builtin capture command
+ *
+ *    capture             print whether capture is on
+ *    capture on [size]   capture the output of the background jobs
+ *                        started from now on, keeping the newest size
+ *                        bytes (K or M suffix, default 64K) of each in
+ *                        memory and spilling the rest to a file
+ *    capture off         let new background jobs write to our stdout
+ */
+void do_capture(char **argv)
+{
+    char *end;
+    long size = CAPSIZE;
+
+    if (argv[1] == NULL) {
+	if (capsize > 0)
+	    printf("capture on, %zu bytes per job\n", capsize);
+	else
+	    printf("capture off\n");
+	return;
+    }
+    if (strcmp(argv[1], "off") == 0 && argv[2] == NULL) {
+	capsize = 0;
+	return;
+    }
+    if (strcmp(argv[1], "on") != 0 || (argv[2] != NULL && argv[3] != NULL)) {
+	printf("Usage: capture [on [size] | off]\n");
+	exitstatus = 2;
+	return;
+    }
+    if (argv[2] != NULL) {
+	size = strtol(argv[2], &end, 10);
+	if (*end == 'K' || *end == 'k')
+	    size <<= 10, end++;
+	else if (*end == 'M' || *end == 'm')
+	    size <<= 20, end++;
+	if (*end != '\0' || end == argv[2] || size < 1024 || size > (1L << 30)) {
+	    printf("capture: %s: the size must be 1K to 1024M\n", argv[2]);
+	    exitstatus = 1;
+	    return;
+	}
+    }
+    capsize = size;
+}
+
+/*
+ * do_output - Execute the builtin output command
+ *
+ *    output                           list the captured outputs
+ *    output [-n lines] [-f] %jid|pid  print the output of a job, or its
+ *                                     last lines (of those still in
+ *                                     memory); with -f, then go on
+ *                                     printing it as it comes, until
+ *                                     it ends or ctrl-c is typed
+ *
+ * The output of a job that has finished is forgotten once all of it
+ * has been printed.
+ */
+void do_output(char **argv)
+{
+    struct capture_t *c;
+    char *end;
+    long lines = -1, id, n;
+    size_t from;
+    int i, follow = 0;
+    pid_t pid;
+
+    if (argv[1] == NULL) {
+	for (c = captures; c != NULL; c = c->next) {
+	    drainall(c);
+	    printf("[%d] (%d) %zu bytes, %zu unread, %s\n", c->jid, c->pid, c->end,
+		   c->end - c->shown, c->job != NULL ? "running" : c->fd >= 0 ? "open" : "done");
+	}
+	return;
+    }
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-'; i++) {
+	if (strcmp(argv[i], "-f") == 0)
+	    follow = 1;
+	else if (strcmp(argv[i], "-n") == 0 && argv[i+1] != NULL &&
+		 (lines = strtol(argv[i+1], &end, 10)) >= 0 && *end == '\0')
+	    i++;
+	else
+	    break;
+    }
+    id = argv[i] == NULL ? -1 : strtol(argv[i] + (argv[i][0] == '%'), &end, 10);
+    if (id <= 0 || *end != '\0' || argv[i+1] != NULL) {
+	printf("Usage: output [-n lines] [-f] %%jid|pid\n");
+	exitstatus = 2;
+	return;
+    }
+    if ((c = argv[i][0] == '%' ? getcapture(id, 0) : getcapture(0, id)) == NULL) {
+	printf("%s: No captured output\n", argv[i]);
+	exitstatus = 1;
+	return;
+    }
+
+    drainall(c);
+    from = 0;
+    if (lines >= 0) {			/* back up over lines newlines */
+	from = c->end;
+	if (from > c->start && c->buf[(from - 1) % c->size] == '\n')
+	    from--;
+	for (n = 0; from > c->start; from--)
+	    if (c->buf[(from - 1) % c->size] == '\n' && ++n > lines - 1)
+		break;
+	if (lines == 0)
+	    from = c->end;
+    }
+    showcapture(c, from);
+
+    pid = c->pid;
+    intr = 0;
+    while (follow && !intr && c->fd >= 0) {
+	waitevent(0, -1);
+	if ((c = getcapture(0, pid)) == NULL)
+	    return;			/* ended, and all shown */
+	showcapture(c, c->shown);
+    }
+    if (from == 0 && c->job == NULL && c->fd < 0)
+	freecapture(c);
+}
+
+/* cmpstr - Order strings for qsort */
+static int cmpstr(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * do_export - Execute the builtin export command
+ *
+ *    export                     list the exported variables
+ *    export NAME[=value]...     set and export variables (a NAME that
+ *                               is not set is exported empty)
+ */
+void do_export(char **argv)
+{
+    char **e, *val;
+    int i, len;
+
+    if (argv[1] == NULL) {
+	e = getenvp();
+	for (i = 0; e[i] != NULL; i++)
+	    ;
+	char *sorted[i + 1];
+	memcpy(sorted, e, (i + 1) * sizeof(char *));
+	qsort(sorted, i, sizeof(char *), cmpstr);
+	for (i = 0; sorted[i] != NULL; i++)
+	    printf("export %s\n", sorted[i]);
+	return;
+    }
+    for (i = 1; argv[i] != NULL; i++) {
+	if ((len = namelen(argv[i])) > 0 && argv[i][len] == '=')
+	    setvar(argv[i], len, argv[i] + len + 1, 1);
+	else if (len > 0 && argv[i][len] == '\0') {
+	    val = getvar(argv[i], len);
+	    setvar(argv[i], len, val != NULL ? val : "", 1);
+	}
+	else {
+	    printf("export: %s: not a valid name\n", argv[i]);
+	    exitstatus = 1;
+	}
+    }
+}
+
+/*
+ * do_unset - Execute the builtin unset command
+ *
+ *    unset NAME...   remove variables, from the environment too
+ */
+void do_unset(char **argv)
+{
+    int i;
+
+    for (i = 1; argv[i] != NULL; i++) {
+	if (namelen(argv[i]) > 0 && argv[i][namelen(argv[i])] == '\0')
+	    unsetvar(argv[i]);
+	else {
+	    printf("unset: %s: not a valid name\n", argv[i]);
+	    exitstatus = 1;
+	}
+    }
+}
+
+/*
+ * timecmd - Execute a time line: time command
+ *
+ * Evaluates the rest of the line as eval would (a job, a pipeline or
+ * a builtin) and prints its wall time, from the monotonic clock; the
+ * CPU time and resources of the jobs it started and that have
+ * finished, from their rusage; and the CPU time of the shell itself,
+ * which is all that a builtin uses. The exit status is the command's.
+ */
+void timecmd(char *cmdline)
+{
+    struct timespec t0, t1;
+    struct rusage self0, self1, ru;
+    struct jobstat_t *js;
+    long first = ndone, i, n = 0;
+
+    if (cmdline[strspn(cmdline, " \t\r\n")] == '\0') {
+	printf("Usage: time command\n");
+	exitstatus = 2;
+	return;
+    }
+    getrusage(RUSAGE_SELF, &self0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    eval(cmdline);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    getrusage(RUSAGE_SELF, &self1);
+
+    memset(&ru, 0, sizeof(ru));
+    if (first < ndone - MAXDONE)
+	first = ndone - MAXDONE;
+    for (i = first; i < ndone; i++) {
+	js = &donejobs[i % MAXDONE];
+	if (tsdiff(&t0, &js->start) >= 0) {	/* started by this line */
+	    addrusage(&ru, &js->ru);
+	    n++;
+	}
+    }
+    timersub(&self1.ru_utime, &self0.ru_utime, &self1.ru_utime);
+    timersub(&self1.ru_stime, &self0.ru_stime, &self1.ru_stime);
+    printf("real   %.6fs\n", tsdiff(&t0, &t1));
+    printf("jobs   %ld  user %.6fs  sys %.6fs  maxrss %ldK  ctxsw %ld/%ld  faults %ld/%ld\n",
+	   n, tvsecs(&ru.ru_utime), tvsecs(&ru.ru_stime), ru.ru_maxrss,
+	   ru.ru_nvcsw, ru.ru_nivcsw, ru.ru_minflt, ru.ru_majflt);
+    printf("shell  user %.6fs  sys %.6fs\n", tvsecs(&self1.ru_utime), tvsecs(&self1.ru_stime));
+    fflush(stdout);
+}
+
+/* cmpll - Order long longs for qsort */
+static int cmpll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* printdur - Print a duration of ns nanoseconds in a readable unit */
+static void printdur(char *label, double ns)
+{
+    if (ns < 1e3)
+	printf("  %s %.0fns", label, ns);
+    else if (ns < 1e6)
+	printf("  %s %.1fus", label, ns / 1e3);
+    else if (ns < 1e9)
+	printf("  %s %.3fms", label, ns / 1e6);
+    else
+	printf("  %s %.3fs", label, ns / 1e9);
+}
+
+/*
+ * benchcmd - Execute a bench line: bench [-n runs] [-w warmup] command
+ *
+ * Evaluates the rest of the line warmup times (default 1), then runs
+ * times (default 10, at most BENCHMAX), each through eval as if it had
+ * been typed, and prints the min, mean, p50, p99 (nearest rank), max
+ * and standard deviation of the wall time of a run, and the mean CPU
+ * time per run of the reaped children and of the shell. ctrl-c stops
+ * it early: the run it interrupts is not timed, and the runs done so
+ * far are reported. The exit status is the last run's.
+ */
+void benchcmd(char *cmdline)
+{
+    struct timespec t0, t1;
+    struct rusage self0, self1, kids0, kids1;
+    long long *lat, sum = 0;
+    long runs = 10, warm = 1, v, i, n = 0;
+    double mean, var = 0;
+    char *p = cmdline, *end;
+
+    while (*(p += strspn(p, " \t")) == '-' && (p[1] == 'n' || p[1] == 'w') && (p[2] == ' ' || p[2] == '\t')) {
+	v = strtol(p + 3, &end, 10);
+	if (end == p + 3 || strchr(" \t", *end) == NULL || v < (p[1] == 'n'))
+	    break;
+	if (p[1] == 'n')
+	    runs = v;
+	else
+	    warm = v;
+	p = end;
+    }
+    if (*p == '-' || p[strspn(p, " \t\r\n")] == '\0') {
+	printf("Usage: bench [-n runs] [-w warmup] command\n");
+	exitstatus = 2;
+	return;
+    }
+    if (runs > BENCHMAX || (lat = malloc(runs * sizeof(long long))) == NULL) {
+	printf("bench: cannot keep %ld runs (at most %d)\n", runs, BENCHMAX);
+	exitstatus = 1;
+	return;
+    }
+
+    intr = 0;
+    for (i = -warm; i < runs && !intr; i++) {
+	if (i == 0) {
+	    getrusage(RUSAGE_SELF, &self0);
+	    getrusage(RUSAGE_CHILDREN, &kids0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	eval(p);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	handlesignals();		/* ctrl-c at a builtin, and finished jobs */
+	if (i >= 0 && !intr)		/* an interrupted run is not timed */
+	    lat[n++] = (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+    }
+    getrusage(RUSAGE_SELF, &self1);
+    getrusage(RUSAGE_CHILDREN, &kids1);
+
+    printf("bench: %ld runs", n);
+    if (n < runs)
+	printf(" of %ld (interrupted)", runs);
+    printf(", %ld warm-up: %.*s\n", warm, (int)strcspn(p, "\r\n"), p);
+    if (n > 0) {
+	qsort(lat, n, sizeof(long long), cmpll);
+	for (i = 0; i < n; i++)
+	    sum += lat[i];
+	mean = (double)sum / n;
+	for (i = 0; i < n; i++)
+	    var += (lat[i] - mean) * (lat[i] - mean);
+	var = n > 1 ? var / (n - 1) : 0;
+	printdur("min", lat[0]);
+	printdur("mean", mean);
+	printdur("p50", lat[(n + 1) / 2 - 1]);
+	printdur("p99", lat[(long)ceil(0.99 * n) - 1]);
+	printdur("max", lat[n - 1]);
+	printdur("stddev", sqrt(var));
+	printf("\n");
+	timersub(&self1.ru_utime, &self0.ru_utime, &self1.ru_utime);
+	timersub(&self1.ru_stime, &self0.ru_stime, &self1.ru_stime);
+	timersub(&kids1.ru_utime, &kids0.ru_utime, &kids1.ru_utime);
+	timersub(&kids1.ru_stime, &kids0.ru_stime, &kids1.ru_stime);
+	printf("  per run:");
+	printdur("jobs user", tvsecs(&kids1.ru_utime) * 1e9 / n);
+	printdur("sys", tvsecs(&kids1.ru_stime) * 1e9 / n);
+	printdur("shell user", tvsecs(&self1.ru_utime) * 1e9 / n);
+	printdur("sys", tvsecs(&self1.ru_stime) * 1e9 / n);
+	printf("\n");
+    }
+    fflush(stdout);
+    free(lat);
+}
+
+/* 
+ * waitfg - Block until process pid is no longer the foreground process
+ *
+ * Instead of polling, sleep in the event loop, which wakes up as soon
+ * as a signal is queued on the signalfd and handles it before we look
+ * at the job again. Signals only change the job table from there, so
+ * no change can slip in between the test and the wait.
+ */
+void waitfg(pid_t pid)
+{
+	struct capture_t *c;
+
+	if((c=getcapture(0,pid))!=NULL && c->job!=NULL && c->job->pid==pid){		/* A captured job: its output so far, then the rest as it comes */
+		c->fg=1;
+		showcapture(c,c->shown);
+	}
+	while(fgpid(&jobs)==pid){							/* Waiting for the process to change the state from the FG */
+		waitevent(0, -1);
+		traceevent(EV_WAKE,'i',pid,fgpid(&jobs)==pid);
+	}
+	if((c=getcapture(0,pid))!=NULL && c->fg){
+		drainall(c);
+		c->fg=0;									/* Captured again if it is stopped and put back */
+		if(c->job==NULL && c->fd<0)
+			freecapture(c);
+	}
+	if(verbose){										/* For Debugging purposes */
+		printf("waitfg: Process (%d) no longer the fg process\n",pid);
+		fflush(stdout);
+	}
+    return;
+}
+
+/*****************
+ * Signal handlers
+ *
+ * These run from the event loop (handlesignals), not in signal
+ * context, once the signal has been read from the signalfd.
+ *****************/
+
+/* 
+ * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
+ *     a child job terminates (becomes a zombie), or stops because it
+ *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
+ *     available zombie children, but doesn't wait for any other
+ *     currently running children to terminate. Any number of pending
+ *     SIGCHLDs are handled by one call.
+ */
+void sigchld_handler(int sig) 
+{
+    int stat;
+    pid_t cpid;
+    struct proc_t *p;
+    struct rusage ru;
+    siginfo_t si;
+    if(verbose){										/* For Debugging purpose */
+	printf("sigchild_handler: entering\n");
+	fflush(stdout);
+    }
+    if(jobs.nuntracked>0){									/* Some child has no pidfd: sweep for exits and stops */
+	while((cpid = wait4(-1, &stat, WNOHANG | WUNTRACED, &ru)) > 0){				/* Reaping every terminated or stopped child, with its resource usage */
+	    traceevent(EV_REAP,'i',cpid,stat);
+	    if((p=getprocpid(&jobs,cpid))==NULL)						/* Not one of our jobs */
+		continue;
+	    if(WIFSTOPPED(stat))
+		stopproc(p,stat);
+	    else
+		reapproc(p,stat,&ru);
+	}
+    }else{
+	/* Exits are reported on each process's pidfd (see reapchild), so only collect stops */
+	while(waitid(P_ALL, 0, &si, WSTOPPED | WNOHANG)==0 && si.si_pid!=0){
+	    stat=W_STOPCODE(si.si_status);
+	    traceevent(EV_REAP,'i',si.si_pid,stat);
+	    if((p=getprocpid(&jobs,si.si_pid))!=NULL)
+		stopproc(p,stat);
+	}
+    }
+    admitjobs();										/* Start queued jobs in the freed slots */
+    dispatchpar();										/* and the parallel run's next ones */
+	
+    if(verbose){										/* for Debugging purposes */
+	printf("sigchild_handler: exiting\n");
+	fflush(stdout);
+    }
+    return;
+}
+
+/*
+ * stopproc - Process p of a job has stopped with wait status stat
+ */
+void stopproc(struct proc_t *p, int stat)
+{
+    struct job_t *j=p->job;
+    int i;
+
+    /* The job is stopped once every process in it that is still alive has stopped */
+    p->stopped=1;
+    for(i=0;i<j->nprocs;i++)
+	if(!j->procs[i].done && !j->procs[i].stopped)
+		break;
+    if(i==j->nprocs && j->state!=ST){
+	printf("Job [%d] (%d) stopped by signal %d\n", j->jid, j->pid, WSTOPSIG(stat));
+	fflush(stdout);
+	setjobstate(&jobs,j,ST);
+	clock_gettime(CLOCK_MONOTONIC,&j->stop);
+    }
+}
+
+/*
+ * reapproc - Process p of a job has been reaped with wait status stat,
+ *    having used the resources in ru. Delete the job with its last one.
+ */
+void reapproc(struct proc_t *p, int stat, struct rusage *ru)
+{
+    struct job_t *j=p->job;
+
+    p->status=stat;
+    addrusage(&j->ru,ru);
+    deleteproc(&jobs,p);
+    if(j->nlive>0)										/* Other processes of the pipeline are still running */
+	return;
+    stat=j->procs[j->nprocs-1].status;								/* The job ends with the status of its last command */
+    savejobstat(j,stat);
+    if(j->state==FG)
+	exitstatus=WIFEXITED(stat)?WEXITSTATUS(stat):128+WTERMSIG(stat);
+
+    if(j->group!=0 && j->group==par.id){							/* One of the parallel builtin's jobs is done */
+	par.running--;
+	par.done++;
+	if(!WIFEXITED(stat) || WEXITSTATUS(stat)!=0)
+		par.failed++;
+    }
+    if(WIFEXITED(stat)){									/* Deleting job from the jobs table of the child which exited normally */
+	if(verbose){										/* For Debugging purpose */
+		printf("sigchld_handler: Job [%d] (%d) deleted\n",j->jid,j->pid);
+		fflush(stdout);			
+		printf("sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n",j->jid,j->pid,WEXITSTATUS(stat));
+		fflush(stdout);
+	}		
+	freejob(&jobs, j);
+    }
+    else if(WIFSIGNALED(stat)){								
+	/* Deleting the job from jobs table and printing appropriate message as job is terminated due to some Signal */
+	if(verbose){										/* For Debugging purpose */
+		printf("sigchld_handler: Job [%d] (%d) deleted\n",j->jid,j->pid);
+		fflush(stdout);
+	}
+	if(j->state==FG){
+		printf("Job [%d] (%d) terminated by signal %d\n", j->jid, j->pid, WTERMSIG(stat));
+		fflush(stdout);
+	}else
+		notejob(j,WTERMSIG(stat));						/* Told at the next prompt or wait */
+	freejob(&jobs, j);
+    }
+}
+
+/* 
+ * sigint_handler - The kernel sends a SIGINT to the shell whenver the
+ *    user types ctrl-c at the keyboard.  Catch it and send it along
+ *    to the foreground job.  
+ */
+void sigint_handler(int sig) 
+{
+    pid_t pid;
+    pid=fgpid(&jobs);										/* getting the PID of Foreground Process */
+    if(verbose){										/* For Debugging purpose */
+    	printf("sigint_handler: entering\n");
+    	fflush(stdout);
+    }
+    if(pid!=0){
+	if(verbose){										/* For Debugging purpose */
+		printf("sigint_handler: Job (%d) killed\n",pid);
+		fflush(stdout);
+	}
+	traceevent(EV_RELAY,'i',SIGINT,pid);
+    	signaljob(jobs.fg,SIGINT);					/* Sending SIGINT(2) to the whole Process Group of the foreground job */
+	intr=1;										/* bench stops after this run */
+    }else if(par.id!=0){
+	par.intr=1;									/* The parallel builtin stops its jobs */
+	dispatchpar();
+    }else{
+	intr=1;										/* wait gives up */
+    }
+    if(verbose){										/* for Debugging purposes */
+    	printf("sigint_handler: exiting\n");
+    	fflush(stdout);
+    }
+    return;
+}
+
+/*
+ * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
+ *     the user types ctrl-z at the keyboard. Catch it and suspend the
+ *     foreground job by sending it a SIGTSTP.  
+ */
+void sigtstp_handler(int sig) 
+{
+    pid_t pid;
+    struct job_t *j;
+    pid=fgpid(&jobs);										/* Getting the PID of the Foreground Process Using fgpid() */
+    j=jobs.fg;									/* The Foreground Job itself (its leader may already have exited) */
+    if(verbose){										/* for Debugging purposes */
+    	printf("sigtstp_handler: entering\n");
+    	fflush(stdout);
+    }
+    if(pid!=0){
+	if(verbose){										/* for Debugging purposes */
+		printf("sigtstp_handler: Job [%d] (%d) stopped\n",j->jid,pid);
+		fflush(stdout);
+	}	
+	traceevent(EV_RELAY,'i',SIGTSTP,j->pid);
+	signaljob(j,SIGTSTP);				/* Sending SIGTSTP(20) to the whole Process Group of the foreground job */
+    }
+    if(verbose){										/* for Debugging purposes */
+    	printf("sigtstp_handler: exiting\n");
+    	fflush(stdout);
+    }
+    return;
+}
+
+/*********************
+ * End signal handlers
+ *********************/
+
+/***********************************************
+ * Helper routines that manipulate the job list
+ **********************************************/
+
+/* clearjob - Clear the entries in a job struct */
+void clearjob(struct job_t *job) {
+    job->pid = 0;
+    job->jid = 0;
+    job->state = UNDEF;
+    if (job->cmdline)
+	job->cmdline[0] = '\0';
+    job->nprocs = 0;
+    job->nlive = 0;
+    job->group = 0;
+    memset(&job->ru, 0, sizeof(job->ru));
+    job->qstages = 0;
+    job->qnredir = 0;
+    job->nice = 0;
+    job->cap = NULL;
+    job->qnext = NULL;
+    job->qprev = NULL;
+    job->next = NULL;
+}
+
+/* initjobs - Initialize the job list */
+void initjobs(struct jobtab_t *jobs) {
+    jobs->jidcap = MINJOBS + 1;
+    jobs->pidcap = MINJOBS;
+    if ((jobs->byjid = calloc(jobs->jidcap, sizeof(struct job_t *))) == NULL ||
+	(jobs->bypid = calloc(jobs->pidcap, sizeof(struct proc_t *))) == NULL)
+	unix_error("initjobs error");
+    jobs->maxjid = 0;
+    jobs->nadded = 0;
+    jobs->njobs = 0;
+    jobs->nprocs = 0;
+    jobs->fg = NULL;
+    jobs->free = NULL;
+}
+
+/* maxjid - Returns largest allocated job ID */
+int maxjid(struct jobtab_t *jobs) 
+{
+    return jobs->maxjid;
+}
+
+/* hashproc - Insert a process into the PID hash */
+static void hashproc(struct jobtab_t *jobs, struct proc_t *proc)
+{
+    struct proc_t **bucket = &jobs->bypid[proc->pid & (jobs->pidcap - 1)];
+
+    proc->next = *bucket;
+    *bucket = proc;
+}
+
+/* unhashproc - Remove a process from the PID hash */
+static void unhashproc(struct jobtab_t *jobs, struct proc_t *proc)
+{
+    struct proc_t **pp;
+
+    for (pp = &jobs->bypid[proc->pid & (jobs->pidcap - 1)]; *pp; pp = &(*pp)->next) {
+	if (*pp == proc) {
+	    *pp = proc->next;
+	    return;
+	}
+    }
+}
+
+/* growjobs - Make room for one more job and n more processes */
+static void growjobs(struct jobtab_t *jobs, int n)
+{
+    struct job_t **tab;
+    struct proc_t **buckets, *proc, *next;
+    int i, cap;
+
+    if (jobs->maxjid + 1 >= jobs->jidcap) {
+	cap = jobs->jidcap * 2;
+	if ((tab = realloc(jobs->byjid, cap * sizeof(struct job_t *))) == NULL)
+	    unix_error("addjob error");
+	memset(tab + jobs->jidcap, 0, (cap - jobs->jidcap) * sizeof(struct job_t *));
+	jobs->byjid = tab;
+	jobs->jidcap = cap;
+    }
+    if (jobs->nprocs + jobs->nreserved + n > jobs->pidcap) {
+	for (cap = jobs->pidcap * 2; jobs->nprocs + jobs->nreserved + n > cap; cap *= 2)
+	    ;
+	if ((buckets = calloc(cap, sizeof(struct proc_t *))) == NULL)
+	    unix_error("addjob error");
+	for (i = 0; i < jobs->pidcap; i++)
+	    for (proc = jobs->bypid[i]; proc; proc = next) {
+		next = proc->next;
+		proc->next = buckets[proc->pid & (cap - 1)];
+		buckets[proc->pid & (cap - 1)] = proc;
+	    }
+	free(jobs->bypid);
+	jobs->bypid = buckets;
+	jobs->pidcap = cap;
+    }
+}
+
+/* addjob - Add a job whose first process is pid to the job list */
+struct job_t *addjob(struct jobtab_t *jobs, pid_t pid, int state, char *cmdline) 
+{
+    struct job_t *job;
+    size_t len;
+    
+    if (pid < 1 && state != QU)		/* only a queued job has no process yet */
+	return NULL;
+
+    growjobs(jobs, pid > 0);
+    if ((job = jobs->free) != NULL)
+	jobs->free = job->next;
+    else if ((job = calloc(1, sizeof(struct job_t))) == NULL)
+	unix_error("addjob error");
+
+    len = strlen(cmdline) + 1;
+    if (job->cmdcap < len) {
+	if ((job->cmdline = realloc(job->cmdline, len)) == NULL)
+	    unix_error("addjob error");
+	job->cmdcap = len;
+    }
+    memcpy(job->cmdline, cmdline, len);
+    job->pid = pid;
+    job->pidfd = -1;
+    job->state = state;
+    job->jid = ++jobs->maxjid;
+    job->serial = ++jobs->nadded;
+    jobs->byjid[job->jid] = job;
+    jobs->njobs++;
+    if (state == FG)
+	jobs->fg = job;
+    if (state == BG)
+	jobs->nbg++;
+    if (pid > 0)
+	addproc(jobs, job, pid);
+    tracejob('b', job);
+    if(verbose){
+	printf("Added job [%d] %d %s\n", job->jid, job->pid, job->cmdline);
+    }
+    return job;
+}
+
+/* addproc - Add process pid to the end of a job's pipeline */
+int addproc(struct jobtab_t *jobs, struct job_t *job, pid_t pid)
+{
+    struct proc_t *procs, *proc;
+    int i;
+
+    if (pid < 1)
+	return 0;
+
+    growjobs(jobs, 1);
+    if (job->nprocs == job->proccap) {
+	/* The array may move, so take its processes out of the hash */
+	for (i = 0; i < job->nprocs; i++)
+	    if (!job->procs[i].done)
+		unhashproc(jobs, &job->procs[i]);
+	job->proccap = job->proccap ? job->proccap * 2 : 1;
+	if ((procs = realloc(job->procs, job->proccap * sizeof(struct proc_t))) == NULL)
+	    unix_error("addproc error");
+	job->procs = procs;
+	for (i = 0; i < job->nprocs; i++)
+	    if (!job->procs[i].done)
+		hashproc(jobs, &job->procs[i]);
+    }
+    proc = &job->procs[job->nprocs++];
+    proc->pid = pid;
+    proc->done = 0;
+    proc->stopped = 0;
+    proc->status = 0;
+    proc->pidfd = -1;
+    proc->job = job;
+    hashproc(jobs, proc);
+    job->nlive++;
+    jobs->nprocs++;
+    jobs->nuntracked++;		/* until trackproc gives it a pidfd */
+    return 1;
+}
+
+/* deleteproc - Mark a process of a job as reaped */
+void deleteproc(struct jobtab_t *jobs, struct proc_t *proc)
+{
+    if (proc->done)
+	return;
+    unhashproc(jobs, proc);
+    if (proc->pidfd >= 0) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, proc->pidfd, NULL);
+	if (proc->pidfd != proc->job->pidfd)	/* the job keeps the leader's */
+	    close(proc->pidfd);
+	proc->pidfd = -1;
+    }
+    else
+	jobs->nuntracked--;
+    proc->done = 1;
+    proc->job->nlive--;
+    jobs->nprocs--;
+}
+
+/* freejob - Remove a job from the job list */
+void freejob(struct jobtab_t *jobs, struct job_t *job)
+{
+    int i;
+
+    tracejob('e', job);
+    for (i = 0; i < job->nprocs; i++)
+	deleteproc(jobs, &job->procs[i]);
+    if (job->pidfd >= 0) {
+	close(job->pidfd);
+	job->pidfd = -1;
+    }
+    jobs->byjid[job->jid] = NULL;
+    /* Each empty slot we step over was freed by a delete, so
+     * lowering maxjid costs O(1) amortized per job */
+    while (jobs->maxjid > 0 && jobs->byjid[jobs->maxjid] == NULL)
+	jobs->maxjid--;
+    if (jobs->fg == job)
+	jobs->fg = NULL;
+    if (job->state == BG)
+	jobs->nbg--;
+    jobs->njobs--;
+    if (job->cap != NULL) {		/* kept until its output is read */
+	job->cap->job = NULL;
+	if (job->cap->fd < 0 && job->cap->shown == job->cap->end)
+	    freecapture(job->cap);
+    }
+    clearjob(job);
+    job->next = jobs->free;
+    jobs->free = job;
+}
+
+/* deletejob - Delete a job whose PID=pid from the job list */
+int deletejob(struct jobtab_t *jobs, pid_t pid) 
+{
+    struct job_t *job;
+
+    if ((job = getjobpid(jobs, pid)) == NULL)
+	return 0;
+    freejob(jobs, job);
+    return 1;
+}
+
+/* setjobstate - Change the state of a job, tracking the foreground job */
+void setjobstate(struct jobtab_t *jobs, struct job_t *job, int state)
+{
+    int i;
+
+    if (jobs->fg == job)
+	jobs->fg = NULL;
+    if (state != ST)			/* continued, so nothing is stopped */
+	for (i = 0; i < job->nprocs; i++)
+	    job->procs[i].stopped = 0;
+    jobs->nbg += (state == BG) - (job->state == BG);
+    job->state = state;
+    if (state == FG)
+	jobs->fg = job;
+}
+
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct jobtab_t *jobs) {
+    return jobs->fg ? jobs->fg->pid : 0;
+}
+
+/* getprocpid - Find a live process (by PID) in the job list */
+struct proc_t *getprocpid(struct jobtab_t *jobs, pid_t pid) {
+    struct proc_t *proc;
+
+    if (pid < 1)
+	return NULL;
+    for (proc = jobs->bypid[pid & (jobs->pidcap - 1)]; proc; proc = proc->next)
+	if (proc->pid == pid)
+	    return proc;
+    return NULL;
+}
+
+/* getjobpid  - Find a job (by the PID of any of its processes) on the job list */
+struct job_t *getjobpid(struct jobtab_t *jobs, pid_t pid) {
+    struct proc_t *proc = getprocpid(jobs, pid);
+
+    return proc ? proc->job : NULL;
+}
+
+/* getjobjid  - Find a job (by JID) on the job list */
+struct job_t *getjobjid(struct jobtab_t *jobs, int jid) 
+{
+    if (jid < 1 || jid > jobs->maxjid)
+	return NULL;
+    return jobs->byjid[jid];
+}
+
+/* pid2jid - Map process ID to job ID */
+int pid2jid(pid_t pid) 
+{
+    struct job_t *job = getjobpid(&jobs, pid);
+
+    return job ? job->jid : 0;
+}
+
+/* listjobs - Print the job list, and the resources used and the
+ *    placement if stats */
+void listjobs(struct jobtab_t *jobs, int stats) 
+{
+    struct job_t *job;
+    struct timespec now;
+    int i, j, n;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 1; i <= jobs->maxjid; i++) {
+	if ((job = jobs->byjid[i]) != NULL) {
+	    printf("[%d] (%d) ", job->jid, job->pid);
+	    switch (job->state) {
+		case BG: 
+		    printf("Running ");
+		    break;
+		case FG: 
+		    printf("Foreground ");
+		    break;
+		case ST: 
+		    printf("Stopped ");
+		    break;
+		case QU: 
+		    printf("Queued ");
+		    break;
+	    default:
+		    printf("listjobs: Internal error: job[%d].state=%d ", 
+			   i, job->state);
+	    }
+	    printf("%s", job->cmdline);
+	    if (stats && job->state != QU) {
+		for (j = n = 0; j < job->nprocs; j++)
+		    n += job->procs[j].done;
+		printf("    reaped %d/%d  ", n, job->nprocs);
+		printrusage(&job->ru);
+		printf("  elapsed %.3fs", tsdiff(&job->start, &now));
+		if (job->state == ST)
+		    printf("  stopped %.3fs ago", tsdiff(&job->stop, &now));
+		printf("\n");
+	    }
+	    if (stats && job->attr.flags) {
+		printf("    placement");
+		printattr(&job->attr);
+		printf("\n");
+	    }
+	    if (stats && job->cap != NULL)
+		printf("    output %zu bytes captured, %zu unread\n",
+		       job->cap->end, job->cap->end - job->cap->shown);
+	}
+    }
+}
+/*****************************
+ * Job resource usage helpers
+ *****************************/
+
+/* tsdiff - Seconds from a to b */
+double tsdiff(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* tvsecs - A timeval in seconds */
+double tvsecs(struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/* addrusage - Add the resources used by a process to a job's total */
+void addrusage(struct rusage *total, struct rusage *ru)
+{
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    if (ru->ru_maxrss > total->ru_maxrss)
+	total->ru_maxrss = ru->ru_maxrss;
+    total->ru_minflt += ru->ru_minflt;
+    total->ru_majflt += ru->ru_majflt;
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/* printrusage - Print the resources in a job's total */
+void printrusage(struct rusage *ru)
+{
+    printf("user %.3fs  sys %.3fs  maxrss %ldK  ctxsw %ld/%ld  faults %ld/%ld",
+	   tvsecs(&ru->ru_utime), tvsecs(&ru->ru_stime), ru->ru_maxrss,
+	   ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_minflt, ru->ru_majflt);
+}
+
+/*
+ * savejobstat - Record a finished job in the ring of finished jobs.
+ *    Called from the SIGCHLD handler.
+ */
+void savejobstat(struct job_t *job, int status)
+{
+    struct jobstat_t *js = &donejobs[ndone % MAXDONE];
+    size_t len = strlen(job->cmdline);
+
+    js->jid = job->jid;
+    js->pid = job->pid;
+    js->status = status;
+    js->nprocs = job->nprocs;
+    js->ru = job->ru;
+    js->start = job->start;
+    clock_gettime(CLOCK_MONOTONIC, &js->end);
+    if (len > sizeof(js->cmdline) - 1)
+	len = sizeof(js->cmdline) - 1;
+    memcpy(js->cmdline, job->cmdline, len);
+    js->cmdline[len] = '\0';
+    if (len > 0 && js->cmdline[len-1] == '\n')
+	js->cmdline[len-1] = '\0';
+    ndone++;
+}
+
+/*
+ * notejob - Hold the notice that background job was killed by signal
+ *    sig, so that it is printed between commands rather than in the
+ *    middle of the output of the one running.
+ */
+void notejob(struct job_t *job, int sig)
+{
+    if (nnotices == MAXNOTICE)
+	flushnotices();
+    notices[nnotices].jid = job->jid;
+    notices[nnotices].pid = job->pid;
+    notices[nnotices].sig = sig;
+    nnotices++;
+}
+
+/* flushnotices - Print the notices held by notejob, oldest first */
+void flushnotices(void)
+{
+    int i;
+
+    for (i = 0; i < nnotices; i++)
+	printf("Job [%d] (%d) terminated by signal %d\n",
+	       notices[i].jid, notices[i].pid, notices[i].sig);
+    if (nnotices > 0)
+	fflush(stdout);
+    nnotices = 0;
+}
+/******************************
+ * end job list helper routines
+ ******************************/
+
+
+/********************************************
+ * Helper routines for the command path cache
+ ********************************************/
+
+/* hashname - Bucket of a command name in the path cache */
+static unsigned hashname(const char *name)
+{
+    unsigned h = 2166136261u;
+
+    while (*name)
+	h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h % HASHSIZE;
+}
+
+/* isexec - Is path an executable regular file? */
+static int isexec(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/* clearhash - Forget every entry in the command path cache */
+void clearhash(void) 
+{
+    struct cmdhash_t *h, *next;
+    int i;
+
+    for (i = 0; i < HASHSIZE; i++) {
+	for (h = cmdhash[i]; h != NULL; h = next) {
+	    next = h->next;
+	    free(h->name);
+	    free(h->path);
+	    free(h);
+	}
+	cmdhash[i] = NULL;
+    }
+    free(hashpath);
+    hashpath = NULL;
+    hashgen++;				/* plans may hold the dropped paths */
+}
+
+/*
+ * findcmd - Return the file to execute for command name, or NULL if
+ *    there is none. Names containing a slash are used as given. Other
+ *    names are searched for on PATH once and then served from the
+ *    cache, which is dropped when PATH changes; an entry whose file
+ *    has gone away is looked up again.
+ */
+char *findcmd(char *name) 
+{
+    struct cmdhash_t *h, **hp;
+    char *path, *dir, *end, *file;
+    size_t dlen, nlen;
+
+    if (strchr(name, '/'))
+	return isexec(name) ? name : NULL;
+
+    if ((path = getvar("PATH", 4)) == NULL)
+	path = "/bin:/usr/bin";
+    if (hashpath == NULL || strcmp(hashpath, path) != 0) {
+	clearhash();
+	if ((hashpath = strdup(path)) == NULL)
+	    unix_error("findcmd error");
+    }
+    if (*name == '\0')
+	return NULL;
+
+    for (hp = &cmdhash[hashname(name)]; (h = *hp) != NULL; hp = &h->next) {
+	if (strcmp(h->name, name) == 0) {
+	    if (isexec(h->path)) {
+		h->hits++;
+		return h->path;
+	    }
+	    *hp = h->next;		/* stale entry: look it up again */
+	    free(h->name);
+	    free(h->path);
+	    free(h);
+	    hashgen++;
+	    break;
+	}
+    }
+
+    nlen = strlen(name);
+    for (dir = path; ; dir = end + 1) {
+	if ((end = strchr(dir, ':')) == NULL)
+	    end = dir + strlen(dir);
+	dlen = end - dir;
+	if ((file = malloc(dlen + nlen + 3)) == NULL)
+	    unix_error("findcmd error");
+	if (dlen == 0)			/* empty entry means the current directory */
+	    sprintf(file, "./%s", name);
+	else
+	    sprintf(file, "%.*s/%s", (int)dlen, dir, name);
+	if (isexec(file)) {
+	    if ((h = malloc(sizeof(struct cmdhash_t))) == NULL ||
+		(h->name = strdup(name)) == NULL)
+		unix_error("findcmd error");
+	    h->path = file;
+	    h->hits = 1;
+	    h->next = cmdhash[hashname(name)];
+	    cmdhash[hashname(name)] = h;
+	    return file;
+	}
+	free(file);
+	if (*end == '\0')
+	    return NULL;
+    }
+}
+/******************************************
+ * end command path cache helper routines
+ ******************************************/
+
+
+/********************************************
+ * Helper routines for the command plan cache
+ ********************************************/
+
+/* hashline - Hash of a command line for the plan cache */
+static unsigned hashline(const char *line)
+{
+    unsigned h = 2166136261u;
+
+    while (*line)
+	h = (h ^ (unsigned char)*line++) * 16777619u;
+    return h;
+}
+
+/*
+ * makeplan - Parse cmdline and resolve its commands into a new plan,
+ *    held once for the caller. Return NULL (after saying why) for a
+ *    blank line, a syntax error or a command that is not found.
+ */
+static struct plan_t *makeplan(char *cmdline, unsigned hash)
+{
+    struct plan_t *plan;
+    struct redir_t *redirs;
+    char **argv, *p;
+    int *stage, bg, nstages, nredirs, pre, nassign, nwords = 0, builtin = -1, searched = 0, i, j;
+    size_t bytes, len;
+
+    if ((bg = parseline(cmdline, &argv)) == -1)
+	return NULL;
+    if ((nstages = splitpipeline(argv, &stage)) == 0) {
+	printf("syntax error near '|'\n");
+	return NULL;
+    }
+    if ((nredirs = splitredirs(argv, stage, nstages, &redirs)) < 0)
+	return NULL;
+    nassign = nassigns(argv + stage[0]);
+    if (argv[stage[0] + nassign] == NULL) {	/* only assignments */
+	if (nstages > 1 || nredirs > 0 || bg) {
+	    printf("syntax error: assignment without a command\n");
+	    return NULL;
+	}
+	pre = nassign;
+    }
+    else if ((pre = prefixlen(argv + stage[0] + nassign)) < 0)
+	return NULL;
+    else
+	pre += nassign;
+    stage[0] += pre;		/* the words before it are copied too */
+    char *path[nstages];
+
+    if (nstages == 1 && argv[stage[0]] != NULL)
+	builtin = findbuiltin(argv[stage[0]]);
+    for (i = 0; i < nstages && builtin < 0 && argv[stage[0]] != NULL; i++) {	/* resolve before building anything */
+	if ((path[i] = findcmd(argv[stage[i]])) == NULL) {
+	    printf("%s: Command not found\n", argv[stage[i]]);
+	    return NULL;
+	}
+	if (strchr(argv[stage[i]], '/') == NULL)
+	    searched = 1;
+    }
+
+    len = strlen(cmdline) + 1;
+    bytes = sizeof(struct plan_t) + nredirs * sizeof(struct redir_t) + len;
+    for (i = 0; i < nstages; i++) {
+	for (j = stage[i] - (i == 0 ? pre : 0); argv[j] != NULL; j++, nwords++)
+	    bytes += strlen(argv[j]) + 1;
+	nwords++;			/* the NULL */
+    }
+    for (i = 0; i < nredirs; i++)
+	if (redirs[i].file != NULL)
+	    bytes += strlen(redirs[i].file) + 1;
+    bytes += nwords * sizeof(char *) + nstages * sizeof(char **);
+    if (builtin < 0) {
+	bytes += nstages * sizeof(char *);
+	for (i = 0; i < nstages; i++)
+	    bytes += strlen(path[i]) + 1;
+    }
+    if ((plan = malloc(bytes)) == NULL)
+	unix_error("makeplan error");
+
+    plan->redirs = (struct redir_t *)(plan + 1);
+    plan->argv = (char **)(plan->redirs + nredirs);
+    plan->argvs = (char ***)(plan->argv + nwords);
+    plan->paths = (char **)(plan->argvs + nstages);
+    p = (char *)(plan->paths + (builtin < 0 ? nstages : 0));
+    plan->line = memcpy(p, cmdline, len);
+    p += len;
+    for (i = 0, nwords = 0; i < nstages; i++) {
+	plan->argvs[i] = plan->argv + nwords + (i == 0 ? pre : 0);
+	for (j = stage[i] - (i == 0 ? pre : 0); argv[j] != NULL; j++) {
+	    plan->argv[nwords++] = strcpy(p, argv[j]);
+	    p += strlen(p) + 1;
+	}
+	plan->argv[nwords++] = NULL;
+	if (builtin < 0) {
+	    plan->paths[i] = strcpy(p, path[i]);
+	    p += strlen(p) + 1;
+	}
+    }
+    for (i = 0; i < nredirs; i++) {
+	plan->redirs[i] = redirs[i];
+	if (redirs[i].file != NULL) {
+	    plan->redirs[i].file = strcpy(p, redirs[i].file);
+	    p += strlen(p) + 1;
+	}
+    }
+    if (builtin >= 0)
+	plan->paths = NULL;
+    plan->nredirs = nredirs;
+    plan->hash = hash;
+    plan->bg = bg;
+    plan->builtin = builtin;
+    plan->nstages = nstages;
+    plan->searched = searched;
+    plan->gen = hashgen;
+    plan->vgen = lineexp;
+    plan->nassign = nassign;
+    plan->refs = 1;
+    plan->hits = 0;
+    plan->hnext = plan->prev = plan->next = NULL;
+    return plan;
+}
+
+/* dropplan - Take a plan out of the cache */
+static void dropplan(struct plan_t *plan)
+{
+    struct plan_t **pp;
+
+    for (pp = &plans.buckets[plan->hash & (plans.nbuckets - 1)]; *pp != plan; pp = &(*pp)->hnext)
+	;
+    *pp = plan->hnext;
+    if (plan->prev)
+	plan->prev->next = plan->next;
+    else
+	plans.head = plan->next;
+    if (plan->next)
+	plan->next->prev = plan->prev;
+    else
+	plans.tail = plan->prev;
+    plans.n--;
+    putplan(plan);
+}
+
+/*
+ * getplan - Return the plan for cmdline, held for the caller until
+ *    putplan, or NULL (after saying why) if there is nothing to run.
+ *    A cached plan is reused unless its paths may have gone stale
+ *    (PATH changed or the path cache was cleared) or a variable may
+ *    have changed since its line was expanded; otherwise the line
+ *    is parsed, resolved and cached, evicting the least recently used
+ *    plan when the cache is full.
+ */
+struct plan_t *getplan(char *cmdline)
+{
+    struct plan_t *plan;
+    unsigned hash = hashline(cmdline);
+
+    if (plans.max > 0 && plans.buckets != NULL) {
+	for (plan = plans.buckets[hash & (plans.nbuckets - 1)]; plan != NULL; plan = plan->hnext)
+	    if (plan->hash == hash && strcmp(plan->line, cmdline) == 0)
+		break;
+	if (plan != NULL && ((plan->searched && (findcmd(""), plan->gen != hashgen)) ||
+			     (plan->vgen != 0 && plan->vgen != vars.gen))) {
+	    dropplan(plan);
+	    plan = NULL;
+	}
+	if (plan != NULL) {
+	    plans.hits++;
+	    plan->hits++;
+	    if (plan != plans.head) {	/* move to the front of the LRU list */
+		plan->prev->next = plan->next;
+		if (plan->next)
+		    plan->next->prev = plan->prev;
+		else
+		    plans.tail = plan->prev;
+		plan->prev = NULL;
+		plan->next = plans.head;
+		plans.head->prev = plan;
+		plans.head = plan;
+	    }
+	    plan->refs++;
+	    return plan;
+	}
+    }
+    if (plans.max > 0)
+	plans.misses++;
+    if ((plan = makeplan(cmdline, hash)) == NULL || plans.max == 0 || plan->vgen == ~0u)
+	return plan;		/* a $? line is parsed each time */
+
+    if (plans.buckets == NULL) {
+	for (plans.nbuckets = 16; plans.nbuckets < plans.max; plans.nbuckets *= 2)
+	    ;
+	if ((plans.buckets = calloc(plans.nbuckets, sizeof(struct plan_t *))) == NULL)
+	    unix_error("getplan error");
+    }
+    while (plans.n >= plans.max) {
+	dropplan(plans.tail);
+	plans.evictions++;
+    }
+    plan->hnext = plans.buckets[hash & (plans.nbuckets - 1)];
+    plans.buckets[hash & (plans.nbuckets - 1)] = plan;
+    plan->next = plans.head;
+    if (plans.head)
+	plans.head->prev = plan;
+    else
+	plans.tail = plan;
+    plans.head = plan;
+    plans.n++;
+    plan->refs++;			/* the cache's reference */
+    return plan;
+}
+
+/* putplan - Release a plan; it is freed once nothing holds it */
+void putplan(struct plan_t *plan)
+{
+    if (--plan->refs == 0)
+	free(plan);
+}
+
+/* clearplans - Forget every cached plan */
+void clearplans(void)
+{
+    while (plans.head != NULL)
+	dropplan(plans.head);
+}
+/******************************************
+ * end command plan cache helper routines
+ ******************************************/
+
+
+/*********************************************
+ * Admission control for background jobs
+ *********************************************/
+
+/*
+ * readpsi - Return the "some avg10" CPU pressure in percent, or 0 if
+ *    it cannot be read. Only uses async-signal-safe calls.
+ */
+static double readpsi(void)
+{
+    char buf[256], *p;
+    int fd, n;
+    double v = 0, scale = 1;
+
+    if ((fd = open("/proc/pressure/cpu", O_RDONLY | O_CLOEXEC)) < 0)
+	return 0;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+	return 0;
+    buf[n] = '\0';
+    if ((p = strstr(buf, "avg10=")) == NULL)
+	return 0;
+    for (p += 6; (*p >= '0' && *p <= '9') || *p == '.'; p++) {
+	if (*p == '.')
+	    scale = 0.1;
+	else if (scale == 1)
+	    v = v * 10 + (*p - '0');
+	else {
+	    v += (*p - '0') * scale;
+	    scale /= 10;
+	}
+    }
+    return v;
+}
+
+/* admitlimit - How many background jobs may run now (0 = any number) */
+int admitlimit(void)
+{
+    struct timespec ts;
+    int n;
+
+    switch (admit.mode) {
+    case ADMIT_FIXED:
+    case ADMIT_CPUS:
+	return admit.base;
+    case ADMIT_PSI:
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (ts.tv_sec != admit.psitime) {	/* avg10 changes slowly */
+	    admit.psi = readpsi();
+	    admit.psitime = ts.tv_sec;
+	}
+	n = admit.base * (100 - admit.psi) / 100;
+	return n > 0 ? n : 1;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * queuejob - Add the pipeline whose commands are argvs[0],
+ *    ..., argvs[nstages-1] (running the programs in paths, with the
+ *    redirections redirs, placed as attr says, and with the nassign
+ *    NAME=value words assigns added to its environment) to the
+ *    admission queue as a job in the QU state. The commands,
+ *    assignments and redirections are copied, and room is made in
+ *    the job table, so that the job can later be started from the
+ *    event loop without allocating. Return the job.
+ */
+struct job_t *queuejob(char ***argvs, char **paths, struct redir_t *redirs, int nredirs, int nstages, char *cmdline, struct attr_t *attr, char **assigns, int nassign)
+{
+    char *p, **v;
+    struct job_t *job;
+    struct proc_t *procs;
+    size_t bytes = 0;
+    int i, j, nvec = 0;
+
+    for (i = 0; i < nstages; i++) {
+	bytes += strlen(paths[i]) + 1;
+	for (j = 0; argvs[i][j] != NULL; j++, nvec++)
+	    bytes += strlen(argvs[i][j]) + 1;
+	nvec += 2;		/* the NULL and the path */
+    }
+    for (i = 0; i < nassign; i++, nvec++)
+	bytes += strlen(assigns[i]) + 1;
+    for (i = 0; i < nredirs; i++)
+	if (redirs[i].file != NULL)
+	    bytes += strlen(redirs[i].file) + 1;
+
+    job = addjob(&jobs, 0, QU, cmdline);
+    if (job->qveccap < nvec) {
+	if ((job->qvec = realloc(job->qvec, nvec * sizeof(char *))) == NULL)
+	    unix_error("queuejob error");
+	job->qveccap = nvec;
+    }
+    if (job->qbufcap < bytes) {
+	if ((job->qbuf = realloc(job->qbuf, bytes)) == NULL)
+	    unix_error("queuejob error");
+	job->qbufcap = bytes;
+    }
+    if (job->qredircap < nredirs) {
+	if ((job->qredir = realloc(job->qredir, nredirs * sizeof(struct redir_t))) == NULL)
+	    unix_error("queuejob error");
+	job->qredircap = nredirs;
+    }
+    if (job->proccap < nstages) {	/* the job has no processes yet */
+	if ((procs = realloc(job->procs, nstages * sizeof(struct proc_t))) == NULL)
+	    unix_error("queuejob error");
+	job->procs = procs;
+	job->proccap = nstages;
+    }
+    growjobs(&jobs, nstages);
+    jobs.nreserved += nstages;
+
+    p = job->qbuf;
+    v = job->qvec;
+    for (i = 0; i < nstages; i++) {
+	for (j = 0; argvs[i][j] != NULL; j++) {
+	    *v++ = strcpy(p, argvs[i][j]);
+	    p += strlen(p) + 1;
+	}
+	*v++ = NULL;
+    }
+    for (i = 0; i < nstages; i++) {
+	*v++ = strcpy(p, paths[i]);
+	p += strlen(p) + 1;
+    }
+    for (i = 0; i < nassign; i++) {
+	*v++ = strcpy(p, assigns[i]);
+	p += strlen(p) + 1;
+    }
+    for (i = 0; i < nredirs; i++) {
+	job->qredir[i] = redirs[i];
+	if (redirs[i].file != NULL) {
+	    job->qredir[i].file = strcpy(p, redirs[i].file);
+	    p += strlen(p) + 1;
+	}
+    }
+    job->qstages = nstages;
+    job->qnassign = nassign;
+    job->qnredir = nredirs;
+    job->attr = *attr;
+    job->attr.cpu = -1;			/* chosen when it is admitted */
+
+    job->qprev = admit.tail;
+    if (admit.tail)
+	admit.tail->qnext = job;
+    else
+	admit.head = job;
+    admit.tail = job;
+    admit.nqueued++;
+    admit.submitted++;
+    return job;
+}
+
+/*
+ * admitjob - Take a queued job off the queue and start it in state
+ *    state; its children get the signal mask mask and the environment
+ *    as it is now, with the job's own assignments. Return 1 if it
+ *    started, 0 (and delete the job) if it could not be.
+ */
+int admitjob(struct job_t *job, int state, sigset_t *mask)
+{
+    char **argvs[job->qstages], **paths, **v;
+    char *env[job->qnassign ? vars.nexported + job->qnassign + 1 : 1];
+    int i;
+
+    if (job->qprev)
+	job->qprev->qnext = job->qnext;
+    else
+	admit.head = job->qnext;
+    if (job->qnext)
+	job->qnext->qprev = job->qprev;
+    else
+	admit.tail = job->qprev;
+    job->qnext = job->qprev = NULL;
+    admit.nqueued--;
+    jobs.nreserved -= job->qstages;
+
+    v = job->qvec;
+    for (i = 0; i < job->qstages; i++) {
+	argvs[i] = v;
+	while (*v++ != NULL)
+	    ;
+    }
+    paths = v;
+    if (launchjob(job, argvs, paths, job->qredir, job->qnredir, job->qstages, job->cmdline, state, mask, &job->attr,
+		  job->qnassign ? cmdenv(env, paths + job->qstages, job->qnassign) : getenvp()) == NULL) {
+	freejob(&jobs, job);
+	return 0;
+    }
+    setjobstate(&jobs, job, state);
+    admit.admitted++;
+    return 1;
+}
+
+/*
+ * admitjobs - Start queued jobs while there are free slots.
+ */
+void admitjobs(void)
+{
+    int limit;
+
+    while (admit.head != NULL) {
+	limit = admitlimit();
+	if (limit > 0 && jobs.nbg >= limit)
+	    break;
+	admitjob(admit.head, BG, &childmask);
+	if (jobs.nbg > admit.peak)
+	    admit.peak = jobs.nbg;
+    }
+}
+
+/*
+ * drainjobs - Start what the current limit allows, then wait until the
+ *    queue is empty (all=0) or also every background job has finished
+ *    (all=1). With all=-1 don't wait at all.
+ */
+void drainjobs(int all)
+{
+    admitjobs();
+    while (all >= 0 && (admit.head != NULL || (all && jobs.nbg > 0)))
+	waitevent(0, -1);
+}
+/**********************************************
+ * end admission control helper routines
+ **********************************************/
+
+
+/*****************************
+ * Shell variable helper routines
+ *****************************/
+
+/* hashvar - Hash of a variable name of len bytes */
+static unsigned hashvar(const char *name, size_t len)
+{
+    unsigned h = 2166136261u;
+
+    while (len-- > 0)
+	h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+/*
+ * findvar - The slot that points to variable name, or to the NULL after
+ *    its chain. The table is made from the environment on first use.
+ */
+static struct var_t **findvar(const char *name, size_t len)
+{
+    struct var_t **vp;
+
+    if (vars.nbuckets == 0)
+	initvars();
+    for (vp = &vars.buckets[hashvar(name, len) & (vars.nbuckets - 1)]; *vp != NULL; vp = &(*vp)->next)
+	if ((*vp)->nlen == len && memcmp((*vp)->str, name, len) == 0)
+	    break;
+    return vp;
+}
+
+/* retire - Free str once envp, which may point to it, has been rebuilt */
+static void retire(char *str)
+{
+    if (vars.nretired == vars.retiredcap) {
+	vars.retiredcap = vars.retiredcap ? vars.retiredcap * 2 : 16;
+	if ((vars.retired = realloc(vars.retired, vars.retiredcap * sizeof(char *))) == NULL)
+	    unix_error("setvar error");
+    }
+    vars.retired[vars.nretired++] = str;
+}
+
+/* growvars - Double the buckets of the variable table */
+static void growvars(void)
+{
+    struct var_t **old = vars.buckets, *v, *next;
+    int i, n = vars.nbuckets;
+
+    vars.nbuckets = n ? n * 2 : MINVARS;
+    if ((vars.buckets = calloc(vars.nbuckets, sizeof(struct var_t *))) == NULL)
+	unix_error("setvar error");
+    for (i = 0; i < n; i++) {
+	for (v = old[i]; v != NULL; v = next) {
+	    next = v->next;
+	    v->next = vars.buckets[hashvar(v->str, v->nlen) & (vars.nbuckets - 1)];
+	    vars.buckets[hashvar(v->str, v->nlen) & (vars.nbuckets - 1)] = v;
+	}
+    }
+    free(old);
+}
+
+/*
+ * initvars - Make a variable of each string of the environment we were
+ *    started with, exported, and point environ at our envp.
+ */
+void initvars(void)
+{
+    char **e, *eq;
+
+    if (vars.nbuckets > 0)
+	return;
+    growvars();
+    for (e = environ; *e != NULL; e++)
+	if ((eq = strchr(*e, '=')) != NULL && eq > *e)
+	    setvar(*e, eq - *e, eq + 1, 1);
+    getenvp();
+}
+
+/* getvar - The value of the variable whose name is the len bytes at name, or NULL */
+char *getvar(const char *name, size_t len)
+{
+    struct var_t *v = *findvar(name, len);
+
+    return v != NULL ? v->str + len + 1 : NULL;
+}
+
+/*
+ * setvar - Set the variable whose name is the len bytes at name to
+ *    value, and export it if export (it stays exported if it was).
+ */
+void setvar(const char *name, size_t len, const char *value, int export)
+{
+    struct var_t **vp = findvar(name, len), *v = *vp;
+    size_t vlen = strlen(value);
+    char *str;
+
+    if (v != NULL && strcmp(v->str + len + 1, value) == 0 && (v->exported || !export))
+	return;				/* no change */
+    if ((str = malloc(len + vlen + 2)) == NULL)
+	unix_error("setvar error");
+    memcpy(str, name, len);
+    str[len] = '=';
+    memcpy(str + len + 1, value, vlen + 1);
+    if (v == NULL) {
+	if ((v = malloc(sizeof(struct var_t))) == NULL)
+	    unix_error("setvar error");
+	v->nlen = len;
+	v->exported = 0;
+	v->next = NULL;
+	*vp = v;
+	vars.n++;
+    }
+    else if (v->exported)
+	retire(v->str);
+    else
+	free(v->str);
+    v->str = str;
+    if (export && !v->exported) {
+	v->exported = 1;
+	vars.nexported++;
+    }
+    if (v->exported)
+	vars.envdirty = 1;
+    vars.gen++;
+    if (vars.n > vars.nbuckets)
+	growvars();
+}
+
+/* unsetvar - Remove a variable */
+void unsetvar(const char *name)
+{
+    struct var_t **vp = findvar(name, strlen(name)), *v = *vp;
+
+    if (v == NULL)
+	return;
+    *vp = v->next;
+    if (v->exported) {
+	retire(v->str);
+	vars.nexported--;
+	vars.envdirty = 1;
+    }
+    else
+	free(v->str);
+    free(v);
+    vars.n--;
+    vars.gen++;
+}
+
+/* namelen - The length of the variable name that s starts with, or 0 */
+int namelen(const char *s)
+{
+    const char *p = s;
+
+    if (!isalpha((unsigned char)*p) && *p != '_')
+	return 0;
+    while (isalnum((unsigned char)*p) || *p == '_')
+	p++;
+    return p - s;
+}
+
+/*
+ * assignlen - If word is an assignment NAME=value, the length of NAME,
+ *    else 0
+ */
+int assignlen(char *word)
+{
+    int len = namelen(word);
+
+    return word[len] == '=' ? len : 0;
+}
+
+/* nassigns - The number of assignments at the start of argv */
+int nassigns(char **argv)
+{
+    int n = 0;
+
+    while (argv[n] != NULL && assignlen(argv[n]) > 0)
+	n++;
+    return n;
+}
+
+/* assignvars - Set the variables of the assignments that make up argv */
+void assignvars(char **argv)
+{
+    int len;
+
+    for (; *argv != NULL; argv++) {
+	len = assignlen(*argv);
+	setvar(*argv, len, *argv + len + 1, 0);
+    }
+}
+
+/*
+ * getenvp - The environment for children: the exported variables,
+ *    rebuilt only if one of them has changed since the last call.
+ */
+char **getenvp(void)
+{
+    struct var_t *v;
+    int i, n = 0;
+
+    if (vars.envp != NULL && !vars.envdirty)
+	return vars.envp;
+    if (vars.nbuckets == 0)
+	initvars();
+    if (vars.nexported + 1 > vars.envcap) {
+	vars.envcap = vars.nexported + 1 > 2 * vars.envcap ? vars.nexported + 1 : 2 * vars.envcap;
+	if ((vars.envp = realloc(vars.envp, vars.envcap * sizeof(char *))) == NULL)
+	    unix_error("getenvp error");
+    }
+    for (i = 0; i < vars.nbuckets; i++)
+	for (v = vars.buckets[i]; v != NULL; v = v->next)
+	    if (v->exported)
+		vars.envp[n++] = v->str;
+    vars.envp[n] = NULL;
+    environ = vars.envp;
+    for (i = 0; i < vars.nretired; i++)
+	free(vars.retired[i]);
+    vars.nretired = 0;
+    vars.envdirty = 0;
+    vars.envgen++;
+    return vars.envp;
+}
+
+/*
+ * cmdenv - Build in e (vars.nexported + n + 1 slots) the environment
+ *    of a command with the n assignments assigns before it: envp with
+ *    those variables replaced or added. The strings are not copied.
+ *    Return e.
+ */
+char **cmdenv(char **e, char **assigns, int n)
+{
+    char **envp = getenvp();
+    int i, j, len, nenv = vars.nexported;
+
+    memcpy(e, envp, (nenv + 1) * sizeof(char *));
+    for (i = 0; i < n; i++) {
+	len = assignlen(assigns[i]);
+	for (j = 0; j < nenv; j++)
+	    if (strncmp(e[j], assigns[i], len + 1) == 0)
+		break;
+	e[j] = assigns[i];
+	if (j == nenv)
+	    e[++nenv] = NULL;
+    }
+    return e;
+}
+/*************************************
+ * end shell variable helper routines
+ *************************************/
+
+
+/*******************************
+ * Output capture helper routines
+ *******************************/
+
+/*
+ * newcapture - Make a capture for a background job about to be started,
+ *    and return it with the write end of its pipe in *wfd, or NULL if
+ *    there is no pipe to be had (the job then writes to our stdout).
+ */
+struct capture_t *newcapture(int *wfd)
+{
+    struct capture_t *c;
+    struct epoll_event ev;
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) < 0)
+	return NULL;
+    if ((c = calloc(1, sizeof(*c))) == NULL)
+	unix_error("capture error");
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);	/* only our end: the job's blocks */
+    ev.events = EPOLLIN;
+    ev.data.u64 = CAPTAG | (uint32_t)fds[0];
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) < 0)
+	unix_error("epoll_ctl error");
+    c->fd = fds[0];
+    c->size = capsize;
+    c->spillfd = -1;
+    c->next = captures;
+    captures = c;
+    *wfd = fds[1];
+    return c;
+}
+
+/* freecapture - Forget a capture and its output */
+void freecapture(struct capture_t *c)
+{
+    struct capture_t **pp;
+
+    for (pp = &captures; *pp != c; pp = &(*pp)->next)
+	;
+    *pp = c->next;
+    if (c->job != NULL)
+	c->job->cap = NULL;
+    if (c->fd >= 0) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+    }
+    if (c->spillfd >= 0)
+	close(c->spillfd);
+    free(c->buf);
+    free(c);
+}
+
+/*
+ * getcapture - The newest capture of job jid (if jid > 0), or of the job
+ *    with process group pid, or NULL.
+ */
+struct capture_t *getcapture(int jid, pid_t pid)
+{
+    struct capture_t *c;
+
+    for (c = captures; c != NULL; c = c->next)
+	if (jid > 0 ? c->jid == jid : c->pid == pid)
+	    return c;
+    return NULL;
+}
+
+/*
+ * spill - Make room in the ring by moving its n oldest bytes to the
+ *    spill file, which is made the first time. If it cannot be written
+ *    the bytes are dropped, and the output shows a gap there.
+ */
+static void spill(struct capture_t *c, size_t n)
+{
+    size_t off, len;
+    ssize_t rc;
+    char name[] = "/tmp/tsh-outXXXXXX";
+
+    if (c->spillfd < 0 && (c->spillfd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600)) < 0 &&
+	(c->spillfd = mkostemp(name, O_CLOEXEC)) >= 0)
+	unlink(name);
+    while (n > 0) {
+	off = c->start % c->size;
+	len = n < c->size - off ? n : c->size - off;
+	if (c->spillfd >= 0 && c->spilled == c->start &&
+	    (rc = pwrite(c->spillfd, c->buf + off, len, c->spilled)) > 0) {
+	    len = rc;
+	    c->spilled += rc;
+	}
+	c->start += len;
+	n -= len;
+    }
+}
+
+/*
+ * drain - Read once from the pipe of c into its ring, and write what
+ *    was read to stdout if c->fg. Return the bytes read, 0 at EOF (the
+ *    pipe is then closed) or -1 if the pipe is empty.
+ */
+static ssize_t drain(struct capture_t *c)
+{
+    size_t off, room;
+    ssize_t rc;
+
+    if (c->fd < 0)
+	return 0;
+    if (c->buf == NULL && (c->buf = malloc(c->size)) == NULL)
+	unix_error("capture error");
+    if (c->end - c->start == c->size)
+	spill(c, c->size / 2);
+    off = c->end % c->size;
+    room = c->size - (c->end - c->start);
+    if ((rc = read(c->fd, c->buf + off, room < c->size - off ? room : c->size - off)) < 0)
+	return -1;
+    if (rc == 0) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	return 0;
+    }
+    c->end += rc;
+    if (c->fg)
+	showcapture(c, c->shown);
+    return rc;
+}
+
+/* drainfd - The pipe fd of a capture is readable: drain it */
+void drainfd(int fd)
+{
+    struct capture_t *c;
+
+    for (c = captures; c != NULL && c->fd != fd; c = c->next)
+	;
+    if (c != NULL && drain(c) == 0 && c->job == NULL && c->shown == c->end)
+	freecapture(c);			/* finished, and nothing left to read */
+}
+
+/* drainall - Read everything that is in the pipe of c now */
+void drainall(struct capture_t *c)
+{
+    while (drain(c) > 0)
+	;
+}
+
+/*
+ * showcapture - Print the output of c from offset from on, and count
+ *    it as shown. The part that was spilled is read back from its file.
+ */
+void showcapture(struct capture_t *c, size_t from)
+{
+    char buf[BATCHBUF];
+    size_t off, len;
+    ssize_t rc;
+
+    for (; from < c->spilled && from < c->start; from += rc) {
+	len = c->spilled - from < sizeof(buf) ? c->spilled - from : sizeof(buf);
+	if ((rc = pread(c->spillfd, buf, len, from)) <= 0)
+	    break;
+	fwrite(buf, 1, rc, stdout);
+    }
+    if (from < c->start)
+	from = c->start;		/* skip what could not be spilled */
+    while (from < c->end) {
+	off = from % c->size;
+	len = c->end - from < c->size - off ? c->end - from : c->size - off;
+	fwrite(c->buf + off, 1, len, stdout);
+	from += len;
+    }
+    fflush(stdout);
+    c->shown = c->end;
+}
+/***************************************
+ * end output capture helper routines
+ ***************************************/
+
+
+/************************
+ * Command input and events
+ ************************/
+
+/*
+ * runinput - Read and evaluate every line of input on fd, until EOF.
+ *
+ * Input is read in BATCHBUF-sized blocks, so lines may be of any
+ * length. Signals that arrived while a line was evaluated are handled
+ * before the next one. Interactive input (the terminal, or a pipe) is
+ * only read once the event loop reports it readable, so child events
+ * are handled while we wait for the user; the prompt is printed
+ * before each line if emit_prompt. The notices of background jobs
+ * killed while a line ran are printed before the next one.
+ *
+ * Otherwise this is a script run in batch mode. A regular file is
+ * mapped into memory in one go. No prompt is printed and stdout is
+ * fully buffered: eval flushes it before starting a job, so our output
+ * is still ordered with the output of the children.
+ */
+void runinput(int fd, int interactive, int emit_prompt)
+{
+    struct stat st;
+    char *data = NULL, *line = NULL, *nl;
+    size_t len = 0, pos = 0, cap = 0, linecap = 0, n;
+    ssize_t rc;
+    int mapped = 0, eof = 0;
+    struct epoll_event ev;
+
+    if (interactive) {
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+	    inpoll = inarmed = 1;
+	else if (errno != EPERM)		/* e.g. /dev/null, which is always readable */
+	    unix_error("epoll_ctl error");
+    }
+    else
+	setvbuf(stdout, NULL, _IOFBF, BATCHBUF);
+    if (!interactive && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+	    madvise(data, st.st_size, MADV_SEQUENTIAL);
+	    len = st.st_size;
+	    mapped = eof = 1;
+	}
+	else
+	    data = NULL;
+    }
+
+    while (1) {
+	flushnotices();
+	if (emit_prompt) {
+	    printf("%s", prompt);
+	    fflush(stdout);
+	}
+
+	/* Find the end of the next line, reading more input if needed */
+	while ((nl = memchr(data + pos, '\n', len - pos)) == NULL && !eof) {
+	    if (pos > 0) {
+		memmove(data, data + pos, len - pos);
+		len -= pos;
+		pos = 0;
+	    }
+	    if (cap - len < BATCHBUF) {
+		cap = cap ? cap * 2 : BATCHBUF * 2;
+		if ((data = realloc(data, cap)) == NULL)
+		    unix_error("runinput error");
+	    }
+	    if (interactive && !waitevent(1, -1))
+		continue;
+	    if ((rc = read(fd, data + len, cap - len)) < 0) {
+		if (errno == EINTR)
+		    continue;
+		unix_error("read error");
+	    }
+	    if (rc == 0)
+		eof = 1;
+	    len += rc;
+	}
+	n = nl ? (size_t)(nl - (data + pos)) + 1 : len - pos;
+	if (n == 0)
+	    break;
+
+	/* eval wants its own NUL-terminated copy of the line */
+	if (n + 1 > linecap) {
+	    linecap = n + 1 > MAXLINE ? n + 1 : MAXLINE;
+	    if ((line = realloc(line, linecap)) == NULL)
+		unix_error("runinput error");
+	}
+	memcpy(line, data + pos, n);
+	line[n] = '\0';
+	pos += n;
+	handlesignals();
+	if (hist.fd >= 0)
+	    runhist(line);
+	else
+	    eval(line);
+	if (interactive)
+	    fflush(stdout);
+    }
+
+    if (mapped)
+	munmap(data, len);
+    else
+	free(data);
+    free(line);
+    flushnotices();
+    fflush(stdout);
+}
+
+/*
+ * initevents - Block the signals the shell handles (remembering the
+ *    mask to give to children) and read them from a signalfd instead,
+ *    which is watched by the epoll set.
+ */
+void initevents(void)
+{
+    sigset_t mask;
+    struct epoll_event ev;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    if (sigprocmask(SIG_BLOCK, &mask, &childmask) < 0)
+	unix_error("sigprocmask error");
+    if ((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+	unix_error("signalfd error");
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("epoll_create1 error");
+    ev.events = EPOLLIN;
+    ev.data.u64 = sigfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) < 0)
+	unix_error("epoll_ctl error");
+}
+
+/*
+ * waitevent - Sleep until a signal arrives, or until the input is
+ *    readable if wantinput, and handle the signals that have arrived.
+ *    Give up after timeout ms unless timeout is -1. Return 1 if the
+ *    input can be read without blocking.
+ *
+ * The input is registered with EPOLLONESHOT and only re-armed when we
+ * want it, so typeahead does not wake us while a job is in the
+ * foreground; readiness seen in the meantime is remembered.
+ */
+int waitevent(int wantinput, int timeout)
+{
+    struct epoll_event ev[64];
+    int i, n, reaped = 0;
+
+    if (wantinput && (inready || !inpoll)) {
+	inready = 0;
+	return 1;
+    }
+    if (wantinput && !inarmed) {
+	ev[0].events = EPOLLIN | EPOLLONESHOT;
+	ev[0].data.u64 = STDIN_FILENO;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, STDIN_FILENO, &ev[0]) < 0)
+	    unix_error("epoll_ctl error");
+	inarmed = 1;
+    }
+    if ((n = epoll_wait(epfd, ev, 64, timeout)) < 0) {
+	if (errno != EINTR)
+	    unix_error("epoll_wait error");
+	return 0;
+    }
+    for (i = 0; i < n; i++) {
+	if (ev[i].data.u64 & PIDTAG) {
+	    reapchild((pid_t)(ev[i].data.u64 & ~PIDTAG));
+	    reaped = 1;
 	}
-    }	
-    return;
+	else if (ev[i].data.u64 & CAPTAG)
+	    drainfd((int)(ev[i].data.u64 & ~CAPTAG));
+	else if (ev[i].data.u64 == (uint64_t)sigfd)
+	    handlesignals();
+	else {
+	    inready = 1;
+	    inarmed = 0;
+	}
+    }
+    if (reaped) {
+	admitjobs();		/* Start queued jobs in the freed slots */
+	dispatchpar();
+    }
+    if (wantinput && inready) {
+	inready = 0;
+	return 1;
+    }
+    return 0;
 }
 
-/* 
- * waitfg - Block until process pid is no longer the foreground process
+/*
+ * trackproc - Open a pidfd for process pid of job, which we have just
+ *    started, and watch it in the epoll set so that its exit is
+ *    reported for it alone. The job keeps the group leader's pidfd to
+ *    send signals to the group with. If there is no pidfd (e.g. out of
+ *    file descriptors), the process is reaped by a wait4() sweep.
  */
-void waitfg(pid_t pid)
+void trackproc(struct job_t *job, pid_t pid)
 {
-	struct job_t *j;
-	j=getjobpid(jobs,pid);									/* Getting the job from the jobs table using getjobpid function */
-	while(j->state==FG){									/* Waiting for the process to change the state from the FG */
-		sleep(1);
-	}
-	if(verbose){										/* For Debugging purposes */
-		printf("waitfg: Process (%d) no longer the fg process\n",pid);
-		fflush(stdout);
-	}
-    return;
+    struct proc_t *p;
+    struct epoll_event ev;
+    int fd;
+
+    if ((p = getprocpid(&jobs, pid)) == NULL || (fd = pidfd_open(pid, 0)) < 0)
+	return;
+    ev.events = EPOLLIN;
+    ev.data.u64 = PIDTAG | (uint32_t)pid;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	close(fd);
+	return;
+    }
+    p->pidfd = fd;
+    jobs.nuntracked--;
+    if (pid == job->pid)
+	job->pidfd = fd;
 }
 
-/*****************
- * Signal handlers
- *****************/
+/* waitstatus - The wait status that waitpid would give for si */
+static int waitstatus(siginfo_t *si)
+{
+    if (si->si_code == CLD_EXITED)
+	return W_EXITCODE(si->si_status, 0);
+    return si->si_status | (si->si_code == CLD_DUMPED ? WCOREFLAG : 0);
+}
 
-/* 
- * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
- *     a child job terminates (becomes a zombie), or stops because it
- *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
- *     available zombie children, but doesn't wait for any other
- *     currently running children to terminate.  
+/*
+ * reapchild - The pidfd of process pid is readable, so it has exited:
+ *    reap it, with its resource usage. Nothing else is waited for.
  */
-void sigchld_handler(int sig) 
+void reapchild(pid_t pid)
 {
-    int stat;
-    pid_t cpid;
-    struct job_t *j;
-    if(verbose){										/* For Debugging purpose */
-	printf("sigchild_handler: entering\n");
-	fflush(stdout);
+    struct proc_t *p;
+    struct rusage ru;
+    siginfo_t si;
+
+    if ((p = getprocpid(&jobs, pid)) == NULL || p->pidfd < 0)
+	return;
+    si.si_pid = 0;
+    if (syscall(SYS_waitid, P_PIDFD, p->pidfd, &si, WEXITED | WNOHANG, &ru) < 0 || si.si_pid == 0)
+	return;			/* not ours to reap (yet) */
+    traceevent(EV_REAP, 'i', pid, waitstatus(&si));
+    reapproc(p, waitstatus(&si), &ru);
+}
+
+/*
+ * signaljob - Send sig to every process of a job. The group is named
+ *    by the leader's pidfd, so the signal cannot reach an unrelated
+ *    process that was given a reused PID. Without a pidfd, or on a
+ *    kernel that cannot signal a group through one, use kill().
+ */
+int signaljob(struct job_t *job, int sig)
+{
+    if (job->pidfd >= 0) {
+	if (pidfd_send_signal(job->pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+	    return 0;
+	if (errno != EINVAL && errno != ENOSYS)
+	    return -1;
     }
-    while((cpid = waitpid(-1, &stat, WNOHANG | WUNTRACED)) > 0){				/* Reaping every terminated or stopped child */
-	    j=getjobpid(jobs,cpid);
+    return kill(-job->pid, sig);
+}
 
-	    if(WIFEXITED(stat)){								/* Deleting job from the jobs table of the child which exited normally */
-		if(verbose){									/* For Debugging purpose */
-			printf("sigchld_handler: Job [%d] (%d) deleted\n",j->jid,j->pid);
-			fflush(stdout);			
-			printf("sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n",j->jid,j->pid,WEXITSTATUS(stat));
-			fflush(stdout);
-	    	}		
-		deletejob(jobs, cpid);
-		
-	    }
-	    else if(WIFSIGNALED(stat)){								
-	/* Deleting the job from jobs table and printing appropriate message as job is terminated due to some Signal */
-		if(verbose){									/* For Debugging purpose */
-			printf("sigchld_handler: Job [%d] (%d) deleted\n",j->jid,j->pid);
-			fflush(stdout);
-		}
-		printf("Job [%d] (%d) terminated by signal %d\n", pid2jid(cpid), cpid, WTERMSIG(stat));
-		fflush(stdout);
-		deletejob(jobs, cpid);
-		
-	    }
-	    else if(WIFSTOPPED(stat)){
-	/* Changing the State of job to ST because job is stopped by signal ( by the use of WUNTRACED ) */
-		printf("Job [%d] (%d) stopped by signal %d\n", pid2jid(cpid), cpid, WSTOPSIG(stat));
-		fflush(stdout);
-		j->state=ST;
+/*
+ * handlesignals - Read every signal queued on the signalfd and run its
+ *    handler. However many children changed state, SIGCHLD is handled
+ *    once, since sigchld_handler reaps them all.
+ */
+void handlesignals(void)
+{
+    struct signalfd_siginfo si[16];
+    ssize_t rc;
+    int i, chld = 0;
+
+    while ((rc = read(sigfd, si, sizeof(si))) > 0) {
+	for (i = 0; i < rc / (ssize_t)sizeof(si[0]); i++) {
+	    switch (si[i].ssi_signo) {
+	    case SIGCHLD:
+		chld = 1;
+		break;
+	    case SIGINT:
+		sigint_handler(SIGINT);
+		break;
+	    case SIGTSTP:
+		sigtstp_handler(SIGTSTP);
+		break;
 	    }
+	}
     }
-	
-    if(verbose){										/* for Debugging purposes */
-	printf("sigchild_handler: exiting\n");
-	fflush(stdout);
-    }
-    return;
+    if (chld)
+	sigchld_handler(SIGCHLD);
 }
 
-/* 
- * sigint_handler - The kernel sends a SIGINT to the shell whenver the
- *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.  
+/****************************
+ * Lifecycle tracing routines
+ ****************************/
+
+static const char *evname[NEVENTS] = {
+    "parse", "fork", "exec", "setpgid", "job", "relay", "reap", "waitfg-wake"
+};
+
+/*
+ * inittrace - Start recording lifecycle events, to be written to file
+ *    as Chrome trace JSON when the shell exits. The ring is a shared
+ *    mapping so that forked children can record their own events.
  */
-void sigint_handler(int sig) 
+void inittrace(char *file)
 {
-    pid_t pid;
-    pid=fgpid(jobs);										/* getting the PID of Foreground Process */
-    if(verbose){										/* For Debugging purpose */
-    	printf("sigint_handler: entering\n");
-    	fflush(stdout);
+    tracebuf = mmap(NULL, sizeof(struct tracebuf_t), PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (tracebuf == MAP_FAILED)
+	unix_error("mmap error");
+    tracefile = file;
+    shellpid = tracepid = getpid();
+    atexit(dumptrace);
+}
+
+/* newevent - Claim the next slot of the trace ring and stamp it */
+static struct tevent_t *newevent(int type, int ph)
+{
+    struct tevent_t *ev;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ev = &tracebuf->ev[__atomic_fetch_add(&tracebuf->next, 1, __ATOMIC_RELAXED) % TRACEBUF];
+    ev->ts = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    ev->type = type;
+    ev->ph = ph;
+    ev->tid = tracepid;
+    return ev;
+}
+
+/*
+ * traceevent - Record an event in the trace ring. Only async-signal-safe
+ *    calls, and a slot is claimed with an atomic increment, so it can be
+ *    called from the signal handlers and from children. The oldest events
+ *    are overwritten once the ring is full.
+ */
+void traceevent(int type, int ph, int a, int b)
+{
+    struct tevent_t *ev;
+
+    if (tracebuf == NULL)
+	return;
+    ev = newevent(type, ph);
+    ev->arg[0] = a;
+    ev->arg[1] = b;
+}
+
+/*
+ * tracejob - Record the start ('b') or end ('e') of a job's async
+ *    slice. The slice is keyed on the job's serial, since its JID is
+ *    reused as soon as the job is gone.
+ */
+void tracejob(int ph, struct job_t *job)
+{
+    struct tevent_t *ev;
+
+    if (tracebuf == NULL)
+	return;
+    ev = newevent(EV_JOB, ph);
+    ev->arg[0] = job->jid;
+    ev->arg[1] = job->pid;
+    ev->arg[2] = job->serial;
+}
+
+/*
+ * dumptrace - Write the trace ring to tracefile in the Chrome trace
+ *    event format, which Perfetto and chrome://tracing can open. Events
+ *    are on one track per process; each job is an async slice from
+ *    addjob to its deletion.
+ */
+void dumptrace(void)
+{
+    FILE *fp;
+    struct tevent_t *ev;
+    unsigned long i, first, n;
+    long t0;
+
+    if (tracebuf == NULL || getpid() != shellpid)	/* not from a child whose exec failed */
+	return;
+    if ((fp = fopen(tracefile, "w")) == NULL) {
+	fprintf(stdout, "%s: %s\n", tracefile, strerror(errno));
+	return;
     }
-    if(pid!=0){
-	if(verbose){										/* For Debugging purpose */
-		printf("sigint_handler: Job (%d) killed\n",pid);
-		fflush(stdout);
+    n = tracebuf->next;
+    first = n > TRACEBUF ? n - TRACEBUF : 0;
+    t0 = first < n ? tracebuf->ev[first % TRACEBUF].ts : 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"tsh\"}}", shellpid);
+    for (i = first; i < n; i++) {
+	ev = &tracebuf->ev[i % TRACEBUF];
+	fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+		evname[ev->type], ev->ph, (ev->ts - t0) / 1e3, shellpid, ev->tid);
+	switch (ev->type) {
+	case EV_PARSE:
+	    if (ev->ph == 'E')
+		fprintf(fp, ",\"args\":{\"bg\":%d}", ev->arg[0]);
+	    break;
+	case EV_FORK:
+	    if (ev->ph == 'E')
+		fprintf(fp, ",\"args\":{\"child\":%d,\"pgid\":%d}", ev->arg[0], ev->arg[1]);
+	    break;
+	case EV_EXEC:
+	    fprintf(fp, ",\"s\":\"t\",\"args\":{\"pgid\":%d}", ev->arg[0]);
+	    break;
+	case EV_SETPGID:
+	    fprintf(fp, ",\"s\":\"t\",\"args\":{\"child\":%d,\"pgid\":%d}", ev->arg[0], ev->arg[1]);
+	    break;
+	case EV_JOB:
+	    fprintf(fp, ",\"cat\":\"job\",\"id\":%d,\"args\":{\"jid\":%d,\"pgid\":%d}",
+		    ev->arg[2], ev->arg[0], ev->arg[1]);
+	    break;
+	case EV_RELAY:
+	    fprintf(fp, ",\"s\":\"t\",\"args\":{\"sig\":%d,\"pgid\":%d}", ev->arg[0], ev->arg[1]);
+	    break;
+	case EV_REAP:
+	    fprintf(fp, ",\"s\":\"t\",\"args\":{\"child\":%d,\"status\":%d}", ev->arg[0], ev->arg[1]);
+	    break;
+	case EV_WAKE:
+	    fprintf(fp, ",\"s\":\"t\",\"args\":{\"pgid\":%d,\"still_fg\":%d}", ev->arg[0], ev->arg[1]);
+	    break;
 	}
-    	kill(-(pid),SIGINT);						/* By using -pid We are sending SIGINT(2) to the whole Process Group with that PID in it */
-    }
-    if(verbose){										/* for Debugging purposes */
-    	printf("sigint_handler: exiting\n");
-    	fflush(stdout);
+	fprintf(fp, "}");
     }
-    return;
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
 }
 
+/*************************
+ * Command history routines
+ *************************/
+
 /*
- * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
- *     the user types ctrl-z at the keyboard. Catch it and suspend the
- *     foreground job by sending it a SIGTSTP.  
+ * inithist - Open (or create) the history log file. Only its magic is
+ *    read: the records are looked at when they are needed. If it is
+ *    not a history log, the shell runs without a history.
  */
-void sigtstp_handler(int sig) 
+void inithist(char *file)
 {
-    pid_t pid;
-    struct job_t *j;
-    pid=fgpid(jobs);										/* Getting the PID of the Foreground Process Using fgpid() */
-    j=getjobpid(jobs,pid);							/* Getting the Job entry in jobs table for the Foreground Process using getjobpid */
-    if(verbose){										/* for Debugging purposes */
-    	printf("sigtstp_handler: entering\n");
-    	fflush(stdout);
+    char magic[sizeof(HISTMAGIC) - 1];
+    struct stat st;
+    int fd;
+
+    if ((fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+	printf("history: %s: %s\n", file, strerror(errno));
+	return;
     }
-    if(pid!=0){
-	if(verbose){										/* for Debugging purposes */
-		printf("sigtstp_handler: Job [%d] (%d) stopped\n",j->jid,pid);
-		fflush(stdout);
-	}	
-	kill(-(j->pid),SIGTSTP);			/* By using -(j->pid) We are sending SIGTSTP(20) to the whole Process Group with the foreground jobs PID */
+    flock(fd, LOCK_EX);			/* another shell may be creating it too */
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+	if (write(fd, HISTMAGIC, sizeof(magic)) != sizeof(magic)) {
+	    printf("history: %s: %s\n", file, strerror(errno));
+	    close(fd);
+	    return;
+	}
     }
-    if(verbose){										/* for Debugging purposes */
-    	printf("sigtstp_handler: exiting\n");
-    	fflush(stdout);
+    else if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+	     memcmp(magic, HISTMAGIC, sizeof(magic)) != 0) {
+	printf("history: %s: not a tsh history file\n", file);
+	close(fd);
+	return;
     }
-    return;
+    hist.fd = fd;
+    trimhist();
+    flock(fd, LOCK_UN);
 }
 
-/*********************
- * End signal handlers
- *********************/
+/* histmap - Map what other shells (and we) have appended since last time */
+static void histmap(void)
+{
+    struct stat st;
+    char *map;
 
-/***********************************************
- * Helper routines that manipulate the job list
- **********************************************/
+    if (fstat(hist.fd, &st) < 0 || (size_t)st.st_size <= hist.maplen)
+	return;
+    if (hist.map == NULL)
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, hist.fd, 0);
+    else
+	map = mremap(hist.map, hist.maplen, st.st_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+	return;
+    hist.map = map;
+    hist.maplen = st.st_size;
+}
 
-/* clearjob - Clear the entries in a job struct */
-void clearjob(struct job_t *job) {
-    job->pid = 0;
-    job->jid = 0;
-    job->state = UNDEF;
-    job->cmdline[0] = '\0';
+/*
+ * histrec - Read the header of the record at off into h and return the
+ *    offset of the next record, or 0 if there is no whole record there.
+ */
+static size_t histrec(size_t off, struct histrec_t *h)
+{
+    if (off < sizeof(HISTMAGIC) - 1 || off + sizeof(*h) + sizeof(uint32_t) > hist.maplen)
+	return 0;
+    memcpy(h, hist.map + off, sizeof(*h));
+    if (h->len == 0 || h->len > hist.maplen - off - sizeof(*h) - sizeof(uint32_t))
+	return 0;			/* blank lines are never kept */
+    return off + sizeof(*h) + h->len + sizeof(uint32_t);
 }
 
-/* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs) {
-    int i;
+/* prevhist - Offset of the record before the one at off, or 0 if none */
+static size_t prevhist(size_t off)
+{
+    struct histrec_t h;
+    uint32_t len;
+    size_t prev;
 
-    for (i = 0; i < MAXJOBS; i++)
-	clearjob(&jobs[i]);
+    if (off < sizeof(HISTMAGIC) - 1 + sizeof(h) + sizeof(len))
+	return 0;
+    memcpy(&len, hist.map + off - sizeof(len), sizeof(len));
+    if (len > off - sizeof(HISTMAGIC) + 1 - sizeof(h) - sizeof(len))
+	return 0;
+    prev = off - sizeof(len) - len - sizeof(h);
+    return histrec(prev, &h) == off ? prev : 0;
 }
 
-/* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs) 
+/* lasthist - Offset of the newest whole record, or 0 if there is none */
+static size_t lasthist(void)
 {
-    int i, max=0;
+    struct histrec_t h;
+    size_t end = hist.maplen;
 
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid > max)
-	    max = jobs[i].jid;
-    return max;
+    /* A shell may be in the middle of appending: skip to a record end */
+    while (end > sizeof(HISTMAGIC) - 1 + sizeof(h) && prevhist(end) == 0)
+	end--;
+    return prevhist(end);
 }
 
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
+/*
+ * trimhist - Cut off a torn record that a shell left at the end of the
+ *    log when it died while appending. Called with the log locked, so
+ *    no shell is appending now.
+ */
+static void trimhist(void)
 {
-    int i;
-    
-    if (pid < 1)
-	return 0;
+    struct histrec_t h;
+    size_t off, end;
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == 0) {
-	    jobs[i].pid = pid;
-	    jobs[i].state = state;
-	    jobs[i].jid = nextjid++;
-	    if (nextjid > MAXJOBS)
-		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
-  	    if(verbose){
-	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            }
-            return 1;
-	}
-    }
-    printf("Tried to create too many jobs\n");
-    return 0;
+    histmap();
+    off = lasthist();
+    end = off != 0 ? histrec(off, &h) : sizeof(HISTMAGIC) - 1;
+    if (hist.map == NULL || end >= hist.maplen)
+	return;
+    if (ftruncate(hist.fd, end) < 0) {
+	printf("history: cannot remove a partial record: %s\n", strerror(errno));
+	return;
+    }
+    munmap(hist.map, hist.maplen);	/* mapped again as it grows */
+    hist.map = NULL;
+    hist.maplen = 0;
 }
 
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid) 
+/* histline - The line of the record at off, and its length in *len */
+static char *histline(size_t off, size_t *len)
 {
-    int i;
+    struct histrec_t h;
 
-    if (pid < 1)
-	return 0;
+    memcpy(&h, hist.map + off, sizeof(h));
+    *len = h.len;
+    return hist.map + off + sizeof(h);
+}
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == pid) {
-	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
-	    return 1;
+/* histprefix - Does the line of the record at off start with p? */
+static int histprefix(size_t off, char *p, size_t plen)
+{
+    size_t len;
+    char *line = histline(off, &len);
+
+    return len >= plen && memcmp(line, p, plen) == 0;
+}
+
+/* histcmp - Order records by their line, then oldest first */
+static int histcmp(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b, xlen, ylen;
+    char *xl = histline(x, &xlen), *yl = histline(y, &ylen);
+    int c = memcmp(xl, yl, xlen < ylen ? xlen : ylen);
+
+    if (c != 0)
+	return c;
+    if (xlen != ylen)
+	return xlen < ylen ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+/* mergehist - Sort the tail of the index and merge it into sorted */
+static void mergehist(void)
+{
+    size_t *merged, i, j, k, n = hist.nsorted + hist.ntail;
+
+    qsort(hist.tail, hist.ntail, sizeof(size_t), histcmp);
+    if ((merged = malloc(n * sizeof(size_t))) == NULL ||
+	(hist.newest = realloc(hist.newest, (n / HISTBLK + 1) * sizeof(size_t))) == NULL)
+	unix_error("history error");
+    for (i = j = k = 0; k < n; k++)
+	merged[k] = j == hist.ntail || (i < hist.nsorted &&
+		    histcmp(&hist.sorted[i], &hist.tail[j]) < 0) ? hist.sorted[i++] : hist.tail[j++];
+    free(hist.sorted);
+    hist.sorted = merged;
+    hist.nsorted = n;
+    hist.ntail = 0;
+    for (k = 0; k < n; k++)
+	if (k % HISTBLK == 0 || merged[k] > hist.newest[k / HISTBLK])
+	    hist.newest[k / HISTBLK] = merged[k];
+}
+
+/*
+ * indexhist - Add the records appended since the last call to the
+ *    index. The first call reads the whole log.
+ */
+static void indexhist(void)
+{
+    struct histrec_t h;
+    size_t off, next;
+
+    histmap();
+    if (hist.indexed == 0)
+	hist.indexed = sizeof(HISTMAGIC) - 1;
+    for (off = hist.indexed; (next = histrec(off, &h)) != 0; off = next) {
+	if (hist.ntail == hist.tailcap) {
+	    hist.tailcap = hist.tailcap ? hist.tailcap * 2 : HISTTAIL;
+	    if ((hist.tail = realloc(hist.tail, hist.tailcap * sizeof(size_t))) == NULL)
+		unix_error("history error");
 	}
+	hist.tail[hist.ntail++] = off;
     }
-    return 0;
+    hist.indexed = off;
+    if (hist.ntail >= HISTTAIL)
+	mergehist();
 }
 
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs) {
-    int i;
+/*
+ * histbound - Index in sorted of the first line that does not sort
+ *    before prefix p (or, if upper, the first that sorts after every
+ *    line starting with p).
+ */
+static size_t histbound(char *p, size_t plen, int upper)
+{
+    size_t lo = 0, hi = hist.nsorted, mid, len;
+    char *line;
+    int c;
 
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].state == FG)
-	    return jobs[i].pid;
-    return 0;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	line = histline(hist.sorted[mid], &len);
+	c = memcmp(line, p, len < plen ? len : plen);
+	if (c == 0 && len < plen)
+	    c = -1;
+	if (c < 0 || (upper && c == 0))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
 }
 
-/* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
+/*
+ * findhist - Offset of the newest record whose line starts with the
+ *    len bytes of prefix, or 0 if there is none.
+ *
+ * The newest HISTSCAN records are tried first, which needs no index.
+ * Then the lines with the prefix are a range of sorted, found by
+ * binary search; the newest of them comes from the newest offset of
+ * each whole block in the range, and a look at the partial ones.
+ */
+size_t findhist(char *prefix, size_t len)
+{
+    size_t off, lo, hi, best = 0;
     int i;
 
-    if (pid < 1)
-	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid)
-	    return &jobs[i];
-    return NULL;
+    histmap();
+    for (off = lasthist(), i = 0; off != 0 && i < HISTSCAN; off = prevhist(off), i++)
+	if (histprefix(off, prefix, len))
+	    return off;
+    if (off == 0)
+	return 0;			/* that was the whole log */
+
+    indexhist();
+    for (i = hist.ntail - 1; i >= 0; i--)	/* newer than everything sorted */
+	if (histprefix(hist.tail[i], prefix, len))
+	    return hist.tail[i];
+    lo = histbound(prefix, len, 0);
+    hi = histbound(prefix, len, 1);
+    while (lo < hi && lo % HISTBLK != 0) {
+	if (hist.sorted[lo] > best)
+	    best = hist.sorted[lo];
+	lo++;
+    }
+    for (; lo + HISTBLK <= hi; lo += HISTBLK)
+	if (hist.newest[lo / HISTBLK] > best)
+	    best = hist.newest[lo / HISTBLK];
+    for (; lo < hi; lo++)
+	if (hist.sorted[lo] > best)
+	    best = hist.sorted[lo];
+    return best;
 }
 
-/* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid) 
+/* cmpoff - Order record offsets, newest first */
+static int cmpoff(const void *a, const void *b)
 {
-    int i;
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
 
-    if (jid < 1)
-	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid == jid)
-	    return &jobs[i];
-    return NULL;
+    return x > y ? -1 : x < y;
 }
 
-/* pid2jid - Map process ID to job ID */
-int pid2jid(pid_t pid) 
+/*
+ * listhist - Print the last count lines of the history, or the last
+ *    count that start with prefix, oldest first. If full, also print
+ *    when each was run, its exit status and how long it took.
+ */
+void listhist(long count, char *prefix, int full)
 {
-    int i;
+    struct histrec_t h;
+    size_t *offs, off, lo, hi, plen = prefix ? strlen(prefix) : 0, len;
+    long n = 0, i;
+    char date[32], *line;
+    time_t when;
 
-    if (pid < 1)
-	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
+    histmap();
+    /* No more lines than the smallest records would fill the log with */
+    if (hist.maplen < sizeof(HISTMAGIC) - 1)
+	return;
+    if ((size_t)count > (hist.maplen - sizeof(HISTMAGIC) + 1) / (sizeof(h) + sizeof(uint32_t) + 1))
+	count = (hist.maplen - sizeof(HISTMAGIC) + 1) / (sizeof(h) + sizeof(uint32_t) + 1);
+    if (count == 0)
+	return;
+    if ((offs = malloc(count * sizeof(size_t))) == NULL)
+	unix_error("history error");
+    for (off = lasthist(), i = 0; off != 0 && n < count; off = prevhist(off), i++) {
+	if (prefix != NULL && i == HISTSCAN)
+	    break;			/* no use walking the whole log for a prefix */
+	if (prefix == NULL || histprefix(off, prefix, plen))
+	    offs[n++] = off;
+    }
+    if (off != 0 && n < count) {
+	/* All the lines with the prefix, from the index; keep the newest */
+	indexhist();
+	lo = histbound(prefix, plen, 0);
+	hi = histbound(prefix, plen, 1);
+	if ((offs = realloc(offs, (hi - lo + hist.ntail + 1) * sizeof(size_t))) == NULL)
+	    unix_error("history error");
+	memcpy(offs, hist.sorted + lo, (hi - lo) * sizeof(size_t));
+	for (n = hi - lo, i = 0; i < (long)hist.ntail; i++)
+	    if (histprefix(hist.tail[i], prefix, plen))
+		offs[n++] = hist.tail[i];
+	qsort(offs, n, sizeof(size_t), cmpoff);
+	if (n > count)
+	    n = count;
+    }
+    for (i = n - 1; i >= 0; i--) {
+	histrec(offs[i], &h);
+	line = histline(offs[i], &len);
+	if (full) {
+	    when = h.when;
+	    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&when));
+	    printf("%s %4d %9.3fs  ", date, h.status, h.msecs / 1e3);
+	}
+	printf("%.*s\n", (int)len, line);
+    }
+    free(offs);
 }
 
-/* listjobs - Print the job list */
-void listjobs(struct job_t *jobs) 
+/*
+ * addhist - Append a line that was run, with its exit status and how
+ *    long it took, to the history log. Blank lines are not kept.
+ */
+void addhist(char *line, int status, long msecs)
 {
-    int i;
-    
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid != 0) {
-	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-	    switch (jobs[i].state) {
-		case BG: 
-		    printf("Running ");
-		    break;
-		case FG: 
-		    printf("Foreground ");
-		    break;
-		case ST: 
-		    printf("Stopped ");
-		    break;
-	    default:
-		    printf("listjobs: Internal error: job[%d].state=%d ", 
-			   i, jobs[i].state);
-	    }
-	    printf("%s", jobs[i].cmdline);
-	}
+    struct histrec_t h;
+    struct stat st;
+    uint32_t len;
+    size_t size;
+    char *rec;
+    int ok, err;
+
+    len = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len-1]))
+	len--;
+    if (strspn(line, " \t") >= len)
+	return;
+    h.when = time(NULL);
+    h.status = status;
+    h.msecs = msecs;
+    h.len = len;
+    if ((rec = malloc(sizeof(h) + len + sizeof(len))) == NULL)
+	unix_error("history error");
+    memcpy(rec, &h, sizeof(h));
+    memcpy(rec + sizeof(h), line, len);
+    memcpy(rec + sizeof(h) + len, &len, sizeof(len));
+    size = sizeof(h) + len + sizeof(len);
+
+    /* Under the lock the log ends at a record, and a short write is undone */
+    flock(hist.fd, LOCK_EX);
+    errno = 0;
+    if ((ok = fstat(hist.fd, &st) == 0)) {
+	ok = write(hist.fd, rec, size) == (ssize_t)size;
+	err = errno ? errno : ENOSPC;
+	if (!ok && ftruncate(hist.fd, st.st_size) < 0)
+	    printf("history: cannot remove a partial record: %s\n", strerror(errno));
+    }
+    else
+	err = errno;
+    flock(hist.fd, LOCK_UN);
+    if (!ok) {
+	printf("history: %s; history disabled\n", strerror(err));
+	close(hist.fd);			/* a full disk costs only the history */
+	hist.fd = -1;
     }
+    free(rec);
 }
-/******************************
- * end job list helper routines
- ******************************/
 
+/*
+ * runhist - Evaluate a line and add it to the history. A line !prefix
+ *    (!! for the last line) is replaced by the newest line in the
+ *    history that starts with prefix, which is echoed first.
+ */
+void runhist(char *line)
+{
+    struct timespec t0, t1;
+    char *p, *recalled = NULL;
+    size_t len, off;
+
+    if (line[0] == '!') {
+	for (len = strlen(line); len > 1 && isspace((unsigned char)line[len-1]); len--)
+	    ;
+	p = line + 1 + (len == 2 && line[1] == '!');
+	if ((off = findhist(p, line + len - p)) == 0) {
+	    printf("%.*s: event not found\n", (int)len, line);
+	    exitstatus = 1;
+	    return;
+	}
+	p = histline(off, &len);
+	if ((recalled = malloc(len + 2)) == NULL)
+	    unix_error("history error");
+	memcpy(recalled, p, len);
+	strcpy(recalled + len, "\n");
+	printf("%s", recalled);
+	line = recalled;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    eval(line);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    addhist(line, exitstatus, (long)(tsdiff(&t0, &t1) * 1000));
+    free(recalled);
+}
 
 /***********************
  * Other helper routines
@@ -710,10 +6670,15 @@ void listjobs(struct job_t *jobs)
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpsz] [-f <file>] [-t <file>] [-H <file>]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -s   launch jobs with posix_spawn instead of fork\n");
+    printf("   -z   launch jobs through a launcher process forked at startup\n");
+    printf("   -f   run the commands in <file> in batch mode\n");
+    printf("   -t   write a lifecycle trace (Chrome trace JSON) to <file> at exit\n");
+    printf("   -H   keep the command history in <file> (default ~/.tsh_history at a terminal)\n");
     exit(1);
 }
 
@@ -0,0 +1,318 @@
+/*
+ * tshbench.c - Load generator and latency benchmark for the tiny shell
+ *
+ * usage: tshbench [-h] [-s <shell>] [-n <n>] [-w <n>] [-m <mix>] [-r <seed>]
+ *                 [-i <line>]... [-l <n>]
+ *
+ * Runs the shell (with its prompt on) on a pair of pipes and feeds it
+ * <n> command lines drawn at random from a weighted mix, one at a
+ * time. The latency of a command is the time from writing its line
+ * to reading the next "tsh> " prompt. The first -w commands warm up
+ * the shell and are not counted. Prints commands/second and the mean,
+ * p50, p99 and p999 latency of each command type.
+ *
+ * The mix is a comma separated list of type=weight, from these types:
+ *     builtin  jobs
+ *     true     /bin/true
+ *     bg       ./myspin 0 &
+ *     int      ./myint 0     (the job kills itself with SIGINT)
+ *     stop     ./mystop 0    (the job stops itself with SIGTSTP; it is
+ *                             then resumed by "fg %<jid>", timed as fg)
+ *
+ * Before the warm-up, each -i line is run once (to set the shell up,
+ * e.g. "bgsched idle"), and -l starts <n> CPU-bound background jobs
+ * that run for the whole benchmark and are killed at its end, to time
+ * the mix on a loaded machine.
+ *
+ * Since it only relies on the prompt and on the job messages, the
+ * same run can be pointed at tshref to compare the two shells.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define TIMEOUT 10000       /* ms to wait for a prompt */
+#define MAXINIT 16          /* most -i lines */
+#define MAXLOAD 256         /* most -l jobs */
+#define LOADCMD "/usr/bin/yes > /dev/null &\n"
+
+struct cmdtype_t {          /* A type of command in the mix */
+    char *name;             /* type name used in the mix */
+    char *line;             /* command line sent to the shell */
+    int weight;             /* relative frequency in the mix */
+    long long *lat;         /* latency of each run, in ns */
+    int n;                  /* number of runs recorded */
+    int cap;                /* slots allocated in lat */
+};
+
+enum { BUILTIN, TRUE, BG, INT, STOP, FG, NTYPES };
+
+struct cmdtype_t types[NTYPES] = {
+    { "builtin", "jobs\n" },
+    { "true",    "/bin/true\n" },
+    { "bg",      "./myspin 0 &\n" },
+    { "int",     "./myint 0\n" },
+    { "stop",    "./mystop 0\n" },
+    { "fg",      NULL },            /* resumes the job a stop left */
+};
+
+int tofd, fromfd;           /* pipes to the shell's stdin and from its stdout */
+char *out;                  /* output of the last command */
+size_t outlen, outcap;
+
+/* now - Current monotonic time in nanoseconds */
+static long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void error(char *msg)
+{
+    fprintf(stderr, "tshbench: %s\n", msg);
+    exit(1);
+}
+
+/* startshell - Run the shell command line on a pair of pipes */
+static pid_t startshell(char *shell)
+{
+    int in[2], out[2];
+    pid_t pid;
+
+    if (pipe(in) < 0 || pipe(out) < 0)
+	error(strerror(errno));
+    if ((pid = fork()) < 0)
+	error(strerror(errno));
+    if (pid == 0) {
+	dup2(in[0], STDIN_FILENO);
+	dup2(out[1], STDOUT_FILENO);
+	close(in[0]); close(in[1]);
+	close(out[0]); close(out[1]);
+	execl("/bin/sh", "sh", "-c", shell, (char *)NULL);
+	_exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    tofd = in[1];
+    fromfd = out[0];
+    return pid;
+}
+
+/*
+ * waitprompt - Read the shell's output until it ends with a prompt.
+ *    The output read is left in out.
+ */
+static void waitprompt(void)
+{
+    struct pollfd pfd = { fromfd, POLLIN, 0 };
+    ssize_t rc;
+
+    outlen = 0;
+    while (outlen < 5 || memcmp(out + outlen - 5, "tsh> ", 5) != 0) {
+	if (outcap - outlen < 4096) {
+	    outcap = outcap ? outcap * 2 : 65536;
+	    if ((out = realloc(out, outcap)) == NULL)
+		error("out of memory");
+	}
+	if (poll(&pfd, 1, TIMEOUT) == 0)
+	    error("timed out waiting for a prompt");
+	if ((rc = read(fromfd, out + outlen, outcap - outlen - 1)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    error(strerror(errno));
+	}
+	if (rc == 0)
+	    error("the shell exited");
+	outlen += rc;
+    }
+    out[outlen] = '\0';
+}
+
+/* runcmd - Send a command line and wait for the next prompt */
+static long long runcmd(char *line)
+{
+    long long t0 = now();
+    size_t len = strlen(line);
+
+    if (write(tofd, line, len) != (ssize_t)len)
+	error("write to the shell failed");
+    waitprompt();
+    return now() - t0;
+}
+
+static void record(struct cmdtype_t *t, long long lat)
+{
+    if (t->n == t->cap) {
+	t->cap = t->cap ? t->cap * 2 : 1024;
+	if ((t->lat = realloc(t->lat, t->cap * sizeof(long long))) == NULL)
+	    error("out of memory");
+    }
+    t->lat[t->n++] = lat;
+}
+
+/* parsemix - Set the weights from a type=weight,... list */
+static void parsemix(char *mix)
+{
+    char *tok, *eq;
+    int i;
+
+    for (tok = strtok(mix, ","); tok != NULL; tok = strtok(NULL, ",")) {
+	if ((eq = strchr(tok, '=')) == NULL)
+	    error("mix entries are type=weight");
+	*eq = '\0';
+	for (i = 0; i < FG; i++)
+	    if (strcmp(tok, types[i].name) == 0)
+		break;
+	if (i == FG)
+	    error("unknown command type in mix");
+	types[i].weight = atoi(eq + 1);
+    }
+}
+
+static int cmplat(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* pct - The q-quantile (nearest rank) of n sorted latencies, in us */
+static double pct(long long *lat, int n, double q)
+{
+    int i = (int)(q * n + 0.999999) - 1;
+
+    return lat[i < 0 ? 0 : i] / 1e3;
+}
+
+static void usage(void)
+{
+    printf("Usage: tshbench [-h] [-s <shell>] [-n <n>] [-w <n>] [-m <mix>] [-r <seed>] [-i <line>]... [-l <n>]\n");
+    printf("   -h   print this message\n");
+    printf("   -s   shell command line to run (default ./tsh)\n");
+    printf("   -n   number of commands to time (default 2000)\n");
+    printf("   -w   number of warm-up commands (default 100)\n");
+    printf("   -m   mix of type=weight (default builtin=40,true=40,bg=10,int=5,stop=5)\n");
+    printf("   -r   random seed (default 1)\n");
+    printf("   -i   run this command line first (can be repeated)\n");
+    printf("   -l   number of CPU-bound background jobs to run meanwhile (default 0)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *shell = "./tsh";
+    char mix[] = "builtin=40,true=40,bg=10,int=5,stop=5";
+    char fgline[32], initline[4096], *p;
+    char *init[MAXINIT];
+    pid_t load[MAXLOAD];
+    int n = 2000, warm = 100, seed = 1, ninit = 0, nload = 0;
+    int c, i, k, r, total, count;
+    long long t0, t1, lat;
+    struct cmdtype_t *t;
+    pid_t pid;
+
+    parsemix(mix);
+    while ((c = getopt(argc, argv, "hs:n:w:m:r:i:l:")) != EOF) {
+	switch (c) {
+	case 's':
+	    shell = optarg;
+	    break;
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 'w':
+	    warm = atoi(optarg);
+	    break;
+	case 'm':
+	    for (i = 0; i < FG; i++)
+		types[i].weight = 0;
+	    parsemix(optarg);
+	    break;
+	case 'r':
+	    seed = atoi(optarg);
+	    break;
+	case 'i':
+	    if (ninit == MAXINIT)
+		error("too many -i lines");
+	    init[ninit++] = optarg;
+	    break;
+	case 'l':
+	    if ((nload = atoi(optarg)) < 0 || nload > MAXLOAD)
+		usage();
+	    break;
+	default:
+	    usage();
+	}
+    }
+    for (i = total = 0; i < FG; i++)
+	total += types[i].weight;
+    if (total <= 0 || n <= 0)
+	usage();
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(seed);
+    pid = startshell(shell);
+    waitprompt();
+    for (i = 0; i < ninit; i++) {
+	snprintf(initline, sizeof(initline), "%s\n", init[i]);
+	runcmd(initline);
+    }
+    for (i = 0; i < nload; i++) {
+	runcmd(LOADCMD);
+	if ((p = strchr(out, '(')) == NULL || (load[i] = atoi(p + 1)) <= 0)
+	    error("could not start a background job");
+    }
+
+    t0 = now();
+    for (i = 0; i < warm + n; i++) {
+	if (i == warm)
+	    t0 = now();
+	for (k = 0, r = rand() % total; r >= types[k].weight; k++)
+	    r -= types[k].weight;
+	lat = runcmd(types[k].line);
+	if (i >= warm)
+	    record(&types[k], lat);
+	if (k == STOP && (p = strstr(out, "Job [")) != NULL) {
+	    snprintf(fgline, sizeof(fgline), "fg %%%d\n", atoi(p + 5));
+	    lat = runcmd(fgline);
+	    if (i >= warm)
+		record(&types[FG], lat);
+	}
+    }
+    t1 = now();
+
+    for (i = 0; i < nload; i++)
+	kill(load[i], SIGKILL);
+    close(tofd);
+    waitpid(pid, NULL, 0);
+
+    for (i = count = 0; i < NTYPES; i++)
+	count += types[i].n;
+    printf("%s: %d commands in %.3f s, %.0f commands/s",
+	   shell, count, (t1 - t0) / 1e9, count / ((t1 - t0) / 1e9));
+    if (nload > 0)
+	printf(", %d background jobs", nload);
+    printf("\n");
+    printf("%-8s %7s %10s %10s %10s %10s  (us)\n", "type", "n", "mean", "p50", "p99", "p999");
+    for (i = 0; i < NTYPES; i++) {
+	t = &types[i];
+	if (t->n == 0)
+	    continue;
+	qsort(t->lat, t->n, sizeof(long long), cmplat);
+	for (k = 0, lat = 0; k < t->n; k++)
+	    lat += t->lat[k];
+	printf("%-8s %7d %10.1f %10.1f %10.1f %10.1f\n", t->name, t->n,
+	       lat / 1e3 / t->n, pct(t->lat, t->n, 0.5),
+	       pct(t->lat, t->n, 0.99), pct(t->lat, t->n, 0.999));
+    }
+    exit(0);
+}
@@ -0,0 +1,328 @@
+/* 
+ * ubench.c - Microbenchmarks for the internals of the tiny shell
+ * 
+ * usage: ubench jobs [n]
+ *        ubench spawn [n] [mb]
+ *        ubench parse [n]
+ *        ubench plan [n]
+ *        ubench history [n]
+ *        ubench env [n] [entries]
+ * jobs:  Times the job table operations (add, lookup by PID and JID,
+ *        delete) for tables of 16 up to <n> live jobs.
+ * spawn: Launches /bin/true <n> times through the fork path, the
+ *        posix_spawn path and the launcher (started before the
+ *        process grows) and reports processes/second for each, after
+ *        growing the process by <mb> megabytes of touched memory.
+ * parse: Tokenizes a few kinds of command lines <n> times each with
+ *        parseline and splitpipeline and reports the time per line
+ *        and the throughput.
+ * plan:  Prepares a few kinds of command lines <n> times each with
+ *        the plan cache off (parse and resolve every time) and on
+ *        (reuse the cached plan), and reports the time per line.
+ * history: Appends <n> lines to a fresh history log, then times
+ *        building its index on the first !prefix recall of an old
+ *        line, and recalls by prefix once it is built. Each recall is
+ *        checked against a walk of the whole log.
+ * env:   Exports <entries> variables, then launches /bin/true <n>
+ *        times through each launch path, first with the cached envp
+ *        (as eval does) and then rebuilding it for every launch, and
+ *        reports the time per launch of each, after the time to get
+ *        the envp alone.
+ *
+ * The shell is compiled into this program (with its main renamed) so
+ * that its routines can be called directly.
+ */
+#define main tsh_main
+#include "tsh.c"
+#undef main
+
+#include <time.h>
+
+/* now - Current monotonic time in nanoseconds */
+static long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* bench_jobs - Fill the job table with n jobs, look each up, empty it */
+static void bench_jobs(int n)
+{
+    long long t0, t1, t2, t3;
+    int i, sum = 0;
+    pid_t base = 1000;
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+	addjob(&jobs, base + 3*i, BG, "./myspin 1 &\n");
+    t1 = now();
+    for (i = 0; i < n; i++) {
+	sum += getjobpid(&jobs, base + 3*i)->jid;
+	sum += getjobjid(&jobs, i + 1)->pid;
+    }
+    t2 = now();
+    for (i = 0; i < n; i++)
+	deletejob(&jobs, base + 3*i);
+    t3 = now();
+    printf("%8d jobs: add %6.1f ns  lookup %6.1f ns  delete %6.1f ns  (%d)\n",
+	   n, (double)(t1 - t0) / n, (double)(t2 - t1) / (2*n),
+	   (double)(t3 - t2) / n, sum & 1);
+}
+
+/* bench_spawn - Launch and reap /bin/true n times with one launch path */
+static void bench_spawn(int n, int spawn, int launcher)
+{
+    char *argv[] = { "/bin/true", NULL };
+    sigset_t mask;
+    long long t0, t1;
+    int i;
+
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    usespawn = spawn;
+    if (!launcher)
+	launchfd = -launchfd - 2;		/* put it aside */
+    t0 = now();
+    for (i = 0; i < n; i++)
+	waitpid(launch(argv[0], argv, getenvp(), &mask, 0, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, NULL), NULL, 0);
+    t1 = now();
+    if (!launcher)
+	launchfd = -launchfd - 2;
+    printf("%-12s %6d launches: %8.0f processes/s  %7.1f us/launch\n",
+	   launcher ? "launcher" : spawn ? "posix_spawn" : "fork", n,
+	   n / ((t1 - t0) / 1e9), (t1 - t0) / 1e3 / n);
+}
+
+/* bench_parse - Parse one command line n times */
+static void bench_parse(char *name, char *line, int n)
+{
+    char **av;
+    int *st;
+    long long t0, t1;
+    int i, sum = 0;
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+	if (parseline(line, &av) >= 0)
+	    sum += splitpipeline(av, &st);
+    t1 = now();
+    printf("%-10s %7zu bytes: %9.1f ns/line  %7.1f MB/s  (%d)\n", name, strlen(line),
+	   (double)(t1 - t0) / n, strlen(line) * (double)n / ((t1 - t0) / 1e3),
+	   sum / n);
+}
+
+/* bench_parses - Parse short, quoted, pipeline and long lines */
+static void bench_parses(int n)
+{
+    char *words, *big;
+    size_t len;
+    int i;
+
+    bench_parse("short", "./myspin 1 &\n", n);
+    bench_parse("trace", "/bin/echo -e tsh> ./myspin 4 \\046\n", n);
+    bench_parse("quoted", "/bin/echo 'a b' \"c \\\"d\\\" e\" f\\ g 'h'\"i\"j\n", n);
+    bench_parse("pipeline", "/bin/cat file | /usr/bin/tr a-z A-Z | /usr/bin/sort | /usr/bin/uniq -c &\n", n);
+
+    if ((words = malloc(100 * 8 + 2)) == NULL)
+	unix_error("malloc error");
+    for (i = 0, len = 0; i < 100; i++)
+	len += sprintf(words + len, "word%03d ", i);
+    strcpy(words + len, "\n");
+    bench_parse("100 words", words, n / 10);
+
+    if ((big = malloc(1 << 20)) == NULL)
+	unix_error("malloc error");
+    for (len = 0; len + sizeof("argument ") < (1 << 20); len += 9)
+	memcpy(big + len, "argument ", 9);
+    strcpy(big + len, "\n");
+    bench_parse("1 MB", big, n / 10000 + 1);
+    free(words);
+    free(big);
+}
+
+/* bench_plan - Get the plan of one command line n times */
+static void bench_plan(char *name, char *line, int n)
+{
+    struct plan_t *plan;
+    long long t0, t1, t2;
+    int i, sum = 0;
+
+    plans.max = 0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+	if ((plan = getplan(line)) != NULL) {
+	    sum += plan->nstages;
+	    putplan(plan);
+	}
+    t1 = now();
+    plans.max = PLANMAX;
+    for (i = 0; i < n; i++)
+	if ((plan = getplan(line)) != NULL) {
+	    sum += plan->nstages;
+	    putplan(plan);
+	}
+    t2 = now();
+    clearplans();
+    printf("%-10s uncached %8.1f ns/line  cached %6.1f ns/line  (%d)\n", name,
+	   (double)(t1 - t0) / n, (double)(t2 - t1) / n, sum / n);
+}
+
+/* histwalk - The newest record starting with prefix, the slow way */
+static size_t histwalk(char *prefix)
+{
+    size_t off;
+
+    for (off = lasthist(); off != 0; off = prevhist(off))
+	if (histprefix(off, prefix, strlen(prefix)))
+	    return off;
+    return 0;
+}
+
+/* bench_history - Fill a history log with n lines and recall from it */
+static void bench_history(int n)
+{
+    char file[] = "/tmp/ubench-histXXXXXX", line[64], prefix[32];
+    long long t0, t1, t2, t3;
+    int fd, i, found = 0;
+    size_t off;
+
+    if ((fd = mkstemp(file)) < 0)
+	unix_error("mkstemp error");
+    close(fd);
+    unlink(file);
+    inithist(file);
+    unlink(file);
+    srand(1);
+    t0 = now();
+    for (i = 0; i < n; i++) {
+	snprintf(line, sizeof(line), "./cmd%d --run %d\n", rand() % (n / 4 + 1), i);
+	addhist(line, 0, 0);
+    }
+    t1 = now();
+    off = findhist("./cmd0 ", 7);		/* among the oldest: builds the index */
+    t2 = now();
+    for (i = 0; i < 1000; i++) {
+	snprintf(prefix, sizeof(prefix), "./cmd%d ", rand() % (n / 4 + 1));
+	found += findhist(prefix, strlen(prefix)) != 0;
+    }
+    t3 = now();
+    for (i = 0; i < 20; i++) {
+	snprintf(prefix, sizeof(prefix), "./cmd%d ", rand() % (n / 2 + 1));
+	if (findhist(prefix, strlen(prefix)) != histwalk(prefix)) {
+	    fprintf(stderr, "ubench: wrong recall for %s\n", prefix);
+	    exit(1);
+	}
+    }
+    printf("%8d lines: append %6.2f us/line  index %8.1f ms  recall %6.2f us  (%d %d)\n",
+	   n, (t1 - t0) / 1e3 / n, (t2 - t1) / 1e6, (t3 - t2) / 1e3 / 1000, found, off != 0);
+}
+
+/* bench_env - Launch /bin/true n times, rebuilding envp each time or not */
+static void bench_env(int n, int spawn, int launcher, int rebuild)
+{
+    char *argv[] = { "/bin/true", NULL };
+    sigset_t mask;
+    long long t0, t1;
+    int i;
+
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    usespawn = spawn;
+    if (!launcher)
+	launchfd = -launchfd - 2;		/* put it aside */
+    t0 = now();
+    for (i = 0; i < n; i++) {
+	vars.envdirty |= rebuild;
+	waitpid(launch(argv[0], argv, getenvp(), &mask, 0, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, NULL), NULL, 0);
+    }
+    t1 = now();
+    if (!launcher)
+	launchfd = -launchfd - 2;
+    printf("%-12s %-8s %6d launches: %7.1f us/launch\n",
+	   launcher ? "launcher" : spawn ? "posix_spawn" : "fork", rebuild ? "rebuilt" : "cached",
+	   n, (t1 - t0) / 1e3 / n);
+}
+
+/* bench_envs - Export entries variables and time each launch path */
+static void bench_envs(int n, int entries)
+{
+    char name[32], value[64];
+    long long t0, t1, t2;
+    int i, path, sum = 0;
+
+    startlauncher();
+    for (i = 0; i < entries; i++) {
+	snprintf(name, sizeof(name), "UBENCH_VAR_%05d", i);
+	snprintf(value, sizeof(value), "/usr/local/lib/ubench/%d:/opt/ubench/%d", i, i);
+	setvar(name, strlen(name), value, 1);
+    }
+    getenvp();
+    t0 = now();
+    for (i = 0; i < n; i++)
+	sum += getenvp() != NULL;
+    t1 = now();
+    for (i = 0; i < n; i++) {
+	vars.envdirty = 1;
+	sum += getenvp() != NULL;
+    }
+    t2 = now();
+    printf("%d exported variables: envp cached %6.1f ns  rebuilt %8.1f ns  (%d)\n", vars.nexported,
+	   (double)(t1 - t0) / n, (double)(t2 - t1) / n, sum / n);
+    for (path = 0; path < 3; path++) {
+	if (path == 2 && launchfd < 0)
+	    break;
+	bench_env(n, path == 1, path == 2, 0);
+	bench_env(n, path == 1, path == 2, 1);
+    }
+}
+
+int main(int argc, char **argv) 
+{
+    int n, max;
+    size_t mb;
+    char *bloat;
+
+    if (argc >= 2 && strcmp(argv[1], "jobs") == 0) {
+	max = argc > 2 ? atoi(argv[2]) : 65536;
+	initjobs(&jobs);
+	for (n = 16; n <= max; n *= 4)
+	    bench_jobs(n);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "spawn") == 0) {
+	n = argc > 2 ? atoi(argv[2]) : 2000;
+	mb = argc > 3 ? atoi(argv[3]) : 0;
+	startlauncher();
+	if (mb > 0) {
+	    if ((bloat = malloc(mb << 20)) == NULL)
+		unix_error("malloc error");
+	    memset(bloat, 1, mb << 20);
+	    printf("shell grown by %zu MB\n", mb);
+	}
+	bench_spawn(n, 0, 0);
+	bench_spawn(n, 1, 0);
+	if (launchfd >= 0)
+	    bench_spawn(n, 0, 1);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "parse") == 0) {
+	bench_parses(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "plan") == 0) {
+	n = argc > 2 ? atoi(argv[2]) : 100000;
+	bench_plan("builtin", "jobs -l\n", n);
+	bench_plan("path", "./myspin 1 &\n", n);
+	bench_plan("search", "sort x\n", n);
+	bench_plan("pipeline", "/bin/cat file | tr a-z A-Z | sort | uniq -c &\n", n);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "history") == 0) {
+	bench_history(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "env") == 0) {
+	n = argc > 2 ? atoi(argv[2]) : 2000;
+	bench_envs(n, argc > 3 ? atoi(argv[3]) : 5000);
+    }
+    else {
+	fprintf(stderr, "Usage: %s jobs [n] | spawn [n] [mb] | parse [n] | plan [n] | history [n] | env [n] [entries]\n", argv[0]);
+	exit(1);
+    }
+    exit(0);
+}